@@ -0,0 +1,115 @@
+/**
+ * Reader for the binary result files written by the dicom module with
+ * `--format binary`. See binaryResult.hpp for the layout.
+ *
+ * Numeric columns are typed array views onto the result bytes, so no
+ * parsing or copying happens for them.
+ */
+
+export type BinaryColumn =
+  | Uint8Array
+  | Int32Array
+  | Uint32Array
+  | Float32Array
+  | Float64Array
+  | string[];
+
+export type BinaryResult = Record<string, BinaryColumn>;
+
+const MAGIC = 'PVMB';
+const VERSION = 1;
+const HEADER_SIZE = 16;
+const DIRECTORY_ENTRY_SIZE = 32;
+
+enum ColumnType {
+  UInt8 = 1,
+  Int32 = 2,
+  UInt32 = 3,
+  Float32 = 4,
+  Float64 = 5,
+  String = 6,
+}
+
+const decoder = new TextDecoder();
+
+function getUint64(view: DataView, offset: number) {
+  return (
+    view.getUint32(offset, true) + view.getUint32(offset + 4, true) * 2 ** 32
+  );
+}
+
+function readStrings(bytes: Uint8Array, offset: number, count: number) {
+  const view = new DataView(bytes.buffer, bytes.byteOffset + offset);
+  const base = offset + 4 * (count + 1);
+  const strings = new Array<string>(count);
+  for (let i = 0; i < count; i += 1) {
+    const start = view.getUint32(4 * i, true);
+    const end = view.getUint32(4 * (i + 1), true);
+    strings[i] = decoder.decode(bytes.subarray(base + start, base + end));
+  }
+  return strings;
+}
+
+export function isBinaryResult(data: Uint8Array) {
+  return (
+    data.length >= HEADER_SIZE &&
+    String.fromCharCode(data[0], data[1], data[2], data[3]) === MAGIC
+  );
+}
+
+export function parseBinaryResult(data: Uint8Array): BinaryResult {
+  if (!isBinaryResult(data)) {
+    throw new Error('Not a binary result');
+  }
+
+  // column data is 8-byte aligned relative to the start of the result
+  const bytes = data.byteOffset % 8 === 0 ? data : data.slice();
+  const { buffer, byteOffset } = bytes;
+  const view = new DataView(buffer, byteOffset, bytes.byteLength);
+
+  const version = view.getUint32(4, true);
+  if (version !== VERSION) {
+    throw new Error(`Unsupported binary result version ${version}`);
+  }
+
+  const result: BinaryResult = {};
+  const columnCount = view.getUint32(8, true);
+  for (let i = 0; i < columnCount; i += 1) {
+    const entry = HEADER_SIZE + i * DIRECTORY_ENTRY_SIZE;
+    const nameOffset = view.getUint32(entry, true);
+    const nameLength = view.getUint32(entry + 4, true);
+    const type = view.getUint32(entry + 8, true);
+    const count = view.getUint32(entry + 12, true);
+    const offset = getUint64(view, entry + 16);
+
+    const name = decoder.decode(
+      bytes.subarray(nameOffset, nameOffset + nameLength)
+    );
+    const start = byteOffset + offset;
+
+    switch (type) {
+      case ColumnType.UInt8:
+        result[name] = new Uint8Array(buffer, start, count);
+        break;
+      case ColumnType.Int32:
+        result[name] = new Int32Array(buffer, start, count);
+        break;
+      case ColumnType.UInt32:
+        result[name] = new Uint32Array(buffer, start, count);
+        break;
+      case ColumnType.Float32:
+        result[name] = new Float32Array(buffer, start, count);
+        break;
+      case ColumnType.Float64:
+        result[name] = new Float64Array(buffer, start, count);
+        break;
+      case ColumnType.String:
+        result[name] = readStrings(bytes, offset, count);
+        break;
+      default:
+        throw new Error(`Unknown column type ${type} for ${name}`);
+    }
+  }
+
+  return result;
+}
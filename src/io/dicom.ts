@@ -2,6 +2,8 @@ import { mat3 } from 'gl-matrix';
 import runPipelineBrowser from 'itk/runPipelineBrowser';
 import IOTypes from 'itk/IOTypes';
 import { readFileAsArrayBuffer } from '@/src/io/io';
+import { parseBinaryResult } from './binaryResult';
+import { parseRawVolume, rawVolumeToItkImage } from './rawVolume';
 import { defer, Deferred } from '../utils';
 import PriorityQueue from '../utils/priorityqueue';
 
@@ -11,6 +13,15 @@ export interface TagSpec {
   strconv?: boolean;
 }
 
+export type ResultFormat = 'json' | 'binary';
+
+export interface ImportResult {
+  // volumes whose slices changed, which need buildVolumeList again
+  volumeIDs: string[];
+  // volumes whose slices all moved to other volumes; they no longer exist
+  removedVolumeIDs: string[];
+}
+
 interface Task {
   deferred: Deferred<any>;
   runArgs: [string, any[], any[] | null, any[] | null];
@@ -25,6 +36,19 @@ export class DICOMIO {
 
   initializeCheck: Promise<void> | null;
 
+  /**
+   * Result format for import, readTags, readTagsBatch and readTRE. Binary
+   * results skip JSON serialization on both sides.
+   */
+  resultFormat: ResultFormat = 'binary';
+
+  /**
+   * Budget in MB for the pixel buffers of buildVolume. Volumes larger than
+   * this are assembled in Z-slabs where the output allows it. 0 means no
+   * limit.
+   */
+  memoryLimitMB: number = 1024;
+
   constructor() {
     this.webWorker = null;
     this.queue = new PriorityQueue<Task>();
@@ -68,6 +92,27 @@ export class DICOMIO {
     this.tasksRunning = false;
   }
 
+  /**
+   * Arguments and output spec for an action that supports --format.
+   */
+  resultTaskArgs(action: string, args: string[]) {
+    const binary = this.resultFormat === 'binary';
+    const path = binary ? 'output.bin' : 'output.json';
+    return {
+      args: [...(binary ? ['--format', 'binary'] : []), action, path, ...args],
+      outputs: [{ path, type: binary ? IOTypes.Binary : IOTypes.Text }],
+    };
+  }
+
+  /**
+   * Parses the output of a task started with resultTaskArgs.
+   */
+  static parseResult(data: string | Uint8Array) {
+    return data instanceof Uint8Array
+      ? parseBinaryResult(data)
+      : JSON.parse(data);
+  }
+
   /**
    * Helper that initializes the webworker.
    *
@@ -96,9 +141,9 @@ export class DICOMIO {
    * Imports files
    * @async
    * @param {File[]} files
-   * @returns VolumeID[] a list of volumes parsed from the files
+   * @returns ImportResult the volumes changed and removed by the files
    */
-  async importFiles(files: File[]): Promise<string[]> {
+  async importFiles(files: File[]): Promise<ImportResult> {
     await this.initialize();
 
     const fileData = await Promise.all(
@@ -111,13 +156,17 @@ export class DICOMIO {
       })
     );
 
+    const { args, outputs } = this.resultTaskArgs(
+      'import',
+      fileData.map((fd) => fd.name)
+    );
     const result = await this.addTask(
       // module
       'dicom',
       // args
-      ['import', 'output.json', ...fileData.map((fd) => fd.name)],
+      args,
       // outputs
-      [{ path: 'output.json', type: IOTypes.Text }],
+      outputs,
       // inputs
       fileData.map((fd) => ({
         path: fd.name,
@@ -126,7 +175,11 @@ export class DICOMIO {
       }))
     );
 
-    return JSON.parse(result.outputs[0].data);
+    const parsed = DICOMIO.parseResult(result.outputs[0].data);
+    return {
+      volumeIDs: parsed?.volumeIDs ?? [],
+      removedVolumeIDs: parsed?.removedVolumeIDs ?? [],
+    };
   }
 
   /**
@@ -162,32 +215,78 @@ export class DICOMIO {
       return `${strconv ? '@' : ''}${tag}`;
     });
 
-    const results = await this.addTask(
-      'dicom',
-      ['readTags', 'output.json', volumeID, String(slice), ...tagsArgs],
-      [{ path: 'output.json', type: IOTypes.Text }],
-      []
-    );
+    const { args, outputs } = this.resultTaskArgs('readTags', [
+      volumeID,
+      String(slice),
+      ...tagsArgs,
+    ]);
+    const results = await this.addTask('dicom', args, outputs, []);
 
-    const json = JSON.parse(results.outputs[0].data) ?? {};
+    const json = DICOMIO.parseResult(results.outputs[0].data) ?? {};
     return tags.reduce((info, t) => {
       const { tag, name } = t;
       if (tag in json) {
-        return { ...info, [name]: json[tag] };
+        // binary results hold each tag as a column of one value
+        const value = Array.isArray(json[tag]) ? json[tag][0] : json[tag];
+        return { ...info, [name]: value };
       }
       return info;
     }, {} as Record<T[number]['name'], string>);
   }
 
+  /**
+   * Reads a list of tags from a range of slices in one call.
+   *
+   * @param {String} volumeID
+   * @param {[]Tag} tags
+   * @param {Integer} start first slice (inclusive)
+   * @param {Integer} end last slice (exclusive)
+   * @returns a column of per-slice values for each tag name
+   */
+  async readTagsBatch<T extends TagSpec[]>(
+    volumeID: string,
+    tags: T,
+    start: number,
+    end: number
+  ): Promise<Record<T[number]['name'], string[]>> {
+    const tagsArgs = tags.map((t) => {
+      const { strconv, tag } = t;
+      return `${strconv ? '@' : ''}${tag}`;
+    });
+
+    const { args, outputs } = this.resultTaskArgs('readTagsBatch', [
+      volumeID,
+      String(start),
+      String(end),
+      ...tagsArgs,
+    ]);
+    const results = await this.addTask('dicom', args, outputs, []);
+
+    const json = DICOMIO.parseResult(results.outputs[0].data) ?? {};
+    return tags.reduce((info, t) => {
+      const { tag, name } = t;
+      if (tag in json) {
+        return { ...info, [name]: json[tag] };
+      }
+      return info;
+    }, {} as Record<T[number]['name'], string[]>);
+  }
+
   /**
    * Retrieves a slice of a volume.
    * @async
    * @param {String} volumeID the volume ID
    * @param {Number} slice the slice to retrieve
    * @param {Boolean} asThumbnail cast image to unsigned char. Defaults to false.
+   * @param {Number} thumbnailSize max thumbnail width/height. Defaults to 64.
    * @returns ItkImage
    */
-  async getVolumeSlice(volumeID: string, slice: number, asThumbnail = false) {
+  async getVolumeSlice(
+    volumeID: string,
+    slice: number,
+    asThumbnail = false,
+    thumbnailSize = 64
+  ) {
     await this.initialize();
 
     const result = await this.addTask(
@@ -198,6 +297,7 @@ export class DICOMIO {
         volumeID,
         String(slice),
         asThumbnail ? '1' : '0',
+        String(thumbnailSize),
       ],
       [{ path: 'output.json', type: IOTypes.Image }],
       [],
@@ -207,23 +307,87 @@ export class DICOMIO {
     return result.outputs[0].data;
   }
 
+  /**
+   * Global args limiting buildVolume memory to `memoryLimitMB`.
+   */
+  static memoryLimitArgs(memoryLimitMB: number) {
+    return memoryLimitMB > 0 ? ['--memory-limit', String(memoryLimitMB)] : [];
+  }
+
   /**
    * Builds a volume for a given volume ID.
+   *
+   * The volume comes back as a raw volume file (see buildVolumeRaw), and the
+   * image's pixels are a view onto it.
    * @async
    * @param {String} volumeID the volume ID
+   * @param {Number} memoryLimitMB pixel buffer budget, 0 for no limit
    * @returns ItkImage
    */
-  async buildVolume(volumeID: string) {
+  async buildVolume(volumeID: string, memoryLimitMB = this.memoryLimitMB) {
+    const image = rawVolumeToItkImage(
+      await this.buildVolumeRaw(volumeID, memoryLimitMB)
+    );
+
+    // FIXME tranpose until itk.js consistently outputs col-major
+    // and ITKHelper is updated.
+    mat3.transpose(image.direction.data, image.direction.data);
+    return image;
+  }
+
+  /**
+   * Builds a volume as a raw volume file: a small header and the pixels,
+   * which are viewed in place rather than parsed.
+   * @async
+   * @param {String} volumeID the volume ID
+   * @param {Number} memoryLimitMB pixel buffer budget, 0 for no limit
+   * @returns RawVolume
+   */
+  async buildVolumeRaw(volumeID: string, memoryLimitMB = this.memoryLimitMB) {
     await this.initialize();
 
     const result = await this.addTask(
       'dicom',
-      ['buildVolume', 'output.json', volumeID],
-      [{ path: 'output.json', type: IOTypes.Image }],
+      [
+        ...DICOMIO.memoryLimitArgs(memoryLimitMB),
+        '--raw',
+        'buildVolume',
+        'output.bin',
+        volumeID,
+      ],
+      [{ path: 'output.bin', type: IOTypes.Binary }],
       [],
       10 // building volumes is high priority
     );
 
+    return parseRawVolume(result.outputs[0].data);
+  }
+
+  /**
+   * Builds a decimated preview of a volume.
+   *
+   * Level L keeps every 2^L-th slice and bins 2^L pixels in-plane. Level 0
+   * is the full-resolution volume.
+   * @async
+   * @param {String} volumeID the volume ID
+   * @param {Number} level the decimation level
+   * @returns ItkImage
+   */
+  async buildVolumePreview(volumeID: string, level: number) {
+    if (level <= 0) {
+      return this.buildVolume(volumeID);
+    }
+
+    await this.initialize();
+
+    const result = await this.addTask(
+      'dicom',
+      ['buildVolumePreview', 'output.json', volumeID, String(level)],
+      [{ path: 'output.json', type: IOTypes.Image }],
+      [],
+      20 // previews should show up before anything else
+    );
+
     // FIXME tranpose until itk.js consistently outputs col-major
     // and ITKHelper is updated.
     const image = result.outputs[0].data;
@@ -231,6 +395,39 @@ export class DICOMIO {
     return image;
   }
 
+  /**
+   * Builds a volume coarse-to-fine.
+   *
+   * First builds one preview at a level with at most `maxPreviewSlices`
+   * slices, then the full-resolution volume, calling `onVolume` with each.
+   * The preview decodes its slices through the module's slice cache, so the
+   * full build reuses them. Resolves with the full-resolution volume.
+   * @async
+   * @param {String} volumeID the volume ID
+   * @param {Number} numSlices number of slices in the volume
+   * @param {Function} onVolume called with (itkImage, level) for each pass
+   * @returns ItkImage
+   */
+  async buildVolumeProgressive(
+    volumeID: string,
+    numSlices: number,
+    onVolume: (image: any, level: number) => void,
+    maxPreviewSlices = 32
+  ) {
+    let level = 0;
+    while (level < 3 && numSlices / 2 ** level > maxPreviewSlices) {
+      level += 1;
+    }
+
+    if (level > 0) {
+      onVolume(await this.buildVolumePreview(volumeID, level), level);
+    }
+
+    const image = await this.buildVolume(volumeID);
+    onVolume(image, 0);
+    return image;
+  }
+
   /**
    * Deletes all files associated with a volume.
    * @async
@@ -241,6 +438,21 @@ export class DICOMIO {
     await this.addTask('dicom', ['deleteVolume', volumeID], [], []);
   }
 
+  /**
+   * Gets hit/miss counters and the size of the slice cache.
+   * @async
+   */
+  async cacheStats(): Promise<Record<string, number>> {
+    await this.initialize();
+    const result = await this.addTask(
+      'dicom',
+      ['cacheStats', 'output.json'],
+      [{ path: 'output.json', type: IOTypes.Text }],
+      []
+    );
+    return JSON.parse(result.outputs[0].data);
+  }
+
   /**
    * Reads a TRE file.
    * @returns JSON
@@ -272,4 +484,41 @@ export class DICOMIO {
 
     return JSON.parse(result.outputs[0].data);
   }
+
+  /**
+   * Reads a TRE file as flat typed arrays.
+   *
+   * Objects are in depth-first order with `ids`, `parents` (-1 for the root)
+   * and `pointOffsets`; the points of object i are
+   * [pointOffsets[i], pointOffsets[i + 1]) in `pointIds`, `positions` (xyz),
+   * `radii` and `colors` (rgba).
+   * @returns BinaryResult
+   */
+  async readTREArrays(file: File) {
+    await this.initialize();
+
+    const fileData = {
+      name: file.name,
+      data: await readFileAsArrayBuffer(file),
+    };
+
+    const result = await this.addTask(
+      // module
+      'dicom',
+      // args
+      ['--format', 'binary', 'readTRE', 'output.bin', file.name],
+      // outputs
+      [{ path: 'output.bin', type: IOTypes.Binary }],
+      // inputs
+      [
+        {
+          path: fileData.name,
+          type: IOTypes.Binary,
+          data: new Uint8Array(fileData.data),
+        },
+      ]
+    );
+
+    return parseBinaryResult(result.outputs[0].data);
+  }
 }
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+struct BenchResult {
+  std::string name;
+  size_t iterations = 0;
+  double nsPerIteration = 0;
+};
+
+using BenchResults = std::vector<BenchResult>;
+
+// Keeps the compiler from dropping benchmarked work whose result is unused.
+inline void benchSink(size_t value) {
+  static volatile size_t sink;
+  sink = sink + value;
+}
+
+/**
+ * Runs fn in doubling batches until a batch takes at least minSeconds, and
+ * records the time per call of that batch.
+ */
+inline void runBenchmark(BenchResults &results, const std::string &name,
+                         const std::function<void()> &fn,
+                         double minSeconds = 0.5) {
+  using Clock = std::chrono::steady_clock;
+
+  // warm up caches, iconv descriptors, etc.
+  fn();
+
+  size_t batch = 1;
+  while (true) {
+    auto start = Clock::now();
+    for (size_t i = 0; i < batch; i++) {
+      fn();
+    }
+    std::chrono::duration<double> elapsed = Clock::now() - start;
+    if (elapsed.count() >= minSeconds || batch >= (size_t(1) << 30)) {
+      results.push_back({name, batch, elapsed.count() * 1e9 / batch});
+      return;
+    }
+    batch *= 2;
+  }
+}
+
+inline nlohmann::json benchResultsToJSON(const BenchResults &results) {
+  nlohmann::json out = nlohmann::json::array();
+  for (const auto &result : results) {
+    out.push_back({{"name", result.name},
+                   {"iterations", result.iterations},
+                   {"nsPerIteration", result.nsPerIteration}});
+  }
+  return out;
+}
+
+struct SyntheticStudySpec;
+
+// Suites, one per source file in bench/
+void charsetBenchmarks(BenchResults &results);
+void dicomBenchmarks(BenchResults &results, const SyntheticStudySpec &spec);
+void treBenchmarks(BenchResults &results);
@@ -0,0 +1,50 @@
+#include <string>
+#include <vector>
+
+#include "../charset.hpp"
+#include "benchmark.hpp"
+
+namespace {
+
+struct CharsetCase {
+  const char *name;
+  const char *charsets;
+  std::vector<std::string> strings;
+};
+
+// Typical PatientName/StudyDescription values
+std::vector<CharsetCase> charsetCases() {
+  return {
+      {"ascii", "", {"Doe^John", "CT CHEST W/O CONTRAST", "HEAD^ROUTINE"}},
+      {"latin1",
+       "ISO_IR 100",
+       {"Buc\xe9^J\xe9r\xf4me", "M\xfcller^Hans", "CT THORAX"}},
+      {"cyrillic",
+       "ISO_IR 144",
+       {"\xbb\xee\xda\x65\xdc\xd5\xe0\xd3\xd5\xe0", "\xb8\xd2\xd0\xdd\xde\xd2"}},
+      {"iso2022jp",
+       "\\ISO 2022 IR 87",
+       {"Yamada^Tarou=\x1b$B;3ED\x1b(B^\x1b$BB@O:\x1b(B=\x1b$B$d$^$@\x1b(B^"
+        "\x1b$B$?$m$&\x1b(B"}},
+  };
+}
+
+} // namespace
+
+void charsetBenchmarks(BenchResults &results) {
+  for (auto &test : charsetCases()) {
+    for (bool fastPath : {false, true}) {
+      CharStringToUTF8Converter conv(test.charsets);
+      conv.setHandlePatientName(true);
+      conv.setUseFastPath(fastPath);
+
+      std::string name = std::string("charset/") + test.name +
+                         (fastPath ? "/fast" : "/iconv");
+      runBenchmark(results, name, [&] {
+        for (const auto &str : test.strings) {
+          benchSink(conv.convertCharStringToUTF8(str).size());
+        }
+      });
+    }
+  }
+}
@@ -0,0 +1,136 @@
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+#include "../dicom.hpp"
+#include "../headerIndex.hpp"
+#include "benchmark.hpp"
+#include "synthetic.hpp"
+
+namespace {
+
+// Runs an action the way the CLI would, e.g. {"readTags", "out.json", ...}.
+int dicom(std::vector<std::string> args) {
+  args.insert(args.begin(), "dicom");
+  std::vector<char *> argv;
+  for (auto &arg : args) {
+    argv.push_back(&arg[0]);
+  }
+  auto positional = parseGlobalOptions(argv.size(), argv.data());
+  return runAction(positional.size(), positional.data());
+}
+
+nlohmann::json readJSON(const std::string &filename) {
+  std::ifstream file(filename);
+  return nlohmann::json::parse(file);
+}
+
+} // namespace
+
+void dicomBenchmarks(BenchResults &results, const SyntheticStudySpec &spec) {
+  // volume dirs and outputs are created in the working directory
+  const std::string workDir = "dicom_bench_work";
+  const std::string studyDir = "study";
+  mkdir(workDir.c_str(), 0777);
+  if (chdir(workDir.c_str()) != 0) {
+    throw std::runtime_error("Cannot enter " + workDir);
+  }
+
+  const std::vector<std::string> files = writeSyntheticStudy(studyDir, spec);
+
+  // In place, so files stay put and each run imports the same paths.
+  std::vector<std::string> importArgs{"--in-place", "import", "import.json"};
+  importArgs.insert(importArgs.end(), files.begin(), files.end());
+  auto deleteVolumes = [&] {
+    for (const auto &volumeID : readJSON("import.json").at("volumeIDs")) {
+      dicom({"deleteVolume", volumeID.get<std::string>()});
+    }
+  };
+
+  // includes deleting the volumes again, which is small next to the scan
+  runBenchmark(
+      results, "dicom/import",
+      [&] {
+        dicom(importArgs);
+        deleteVolumes();
+      },
+      0);
+
+  // the same study arriving in 8 chunks, as from a PACS push; each import
+  // only parses its own chunk
+  runBenchmark(
+      results, "dicom/import/chunked",
+      [&] {
+        std::set<std::string> volumeIDs;
+        const size_t chunk = (files.size() + 7) / 8;
+        for (size_t start = 0; start < files.size(); start += chunk) {
+          std::vector<std::string> args{"--in-place", "import", "import.json"};
+          args.insert(args.end(), files.begin() + start,
+                      files.begin() + std::min(files.size(), start + chunk));
+          dicom(args);
+          for (const auto &volumeID : readJSON("import.json").at("volumeIDs")) {
+            volumeIDs.insert(volumeID.get<std::string>());
+          }
+        }
+        for (const auto &volumeID : volumeIDs) {
+          dicom({"deleteVolume", volumeID});
+        }
+      },
+      0);
+
+  const HeaderMapType seriesMap = SeparateOnSeries(scanHeaders(files));
+  runBenchmark(results, "dicom/separateOnImageOrientation", [&] {
+    benchSink(SeparateOnImageOrientation(seriesMap).size());
+  });
+
+  dicom(importArgs);
+  const std::string volumeID = readJSON("import.json").at("volumeIDs").at(0);
+  dicom({"buildVolumeList", "list.json", volumeID});
+  const unsigned long numSlices = readJSON("list.json").get<unsigned long>();
+
+  runBenchmark(results, "dicom/buildVolumeList", [&] {
+    dicom({"buildVolumeList", "list.json", volumeID});
+  });
+
+  unsigned long slice = 0;
+  auto nextSlice = [&] { return std::to_string(slice++ % numSlices); };
+
+  runBenchmark(results, "dicom/readTags", [&] {
+    dicom({"readTags", "tags.json", volumeID, nextSlice(), "0010|0010",
+           "0008|103e", "0020|0013", "0020|0032"});
+  });
+
+  runBenchmark(results, "dicom/getSliceImage", [&] {
+    dicom({"getSliceImage", "slice.nrrd", volumeID, nextSlice(), "0"});
+  });
+
+  // thumbnails are cached, so this is the cold path only on the first pass
+  runBenchmark(results, "dicom/getSliceImage/thumbnail", [&] {
+    dicom({"getSliceImage", "thumb.nrrd", volumeID, nextSlice(), "1"});
+  });
+
+  runBenchmark(
+      results, "dicom/buildVolume",
+      [&] { dicom({"buildVolume", "volume.nrrd", volumeID}); }, 0);
+
+  deleteVolumes();
+  for (const auto &file : files) {
+    std::remove(file.c_str());
+  }
+  for (const char *output : {"import.json", "list.json", "tags.json",
+                             "slice.nrrd", "thumb.nrrd", "volume.nrrd"}) {
+    std::remove(output);
+  }
+  rmdir(studyDir.c_str());
+  if (chdir("..") == 0) {
+    rmdir(workDir.c_str());
+  }
+}
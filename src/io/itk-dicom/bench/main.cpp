@@ -0,0 +1,49 @@
+#include <iostream>
+#include <string>
+
+#include "benchmark.hpp"
+#include "synthetic.hpp"
+
+// dicom_bench [--series N] [--slices N] [--size N] [--seed N] [SUITE]
+// Runs all suites, or only the named one, and prints results as JSON. The
+// options set the shape of the synthetic study used by the dicom suite.
+int main(int argc, char *argv[]) {
+  std::string only;
+  SyntheticStudySpec spec;
+  for (int i = 1; i < argc; i++) {
+    std::string arg(argv[i]);
+    if (arg == "--series" && i + 1 < argc) {
+      spec.series = std::stoul(argv[++i]);
+    } else if (arg == "--slices" && i + 1 < argc) {
+      spec.slicesPerSeries = std::stoul(argv[++i]);
+    } else if (arg == "--size" && i + 1 < argc) {
+      spec.rows = spec.columns = std::stoul(argv[++i]);
+    } else if (arg == "--seed" && i + 1 < argc) {
+      spec.seed = std::stoul(argv[++i]);
+    } else {
+      only = arg;
+    }
+  }
+
+  BenchResults results;
+  if (only.empty() || only == "charset") {
+    charsetBenchmarks(results);
+  }
+  if (only.empty() || only == "dicom") {
+    dicomBenchmarks(results, spec);
+  }
+  if (only.empty() || only == "tre") {
+    treBenchmarks(results);
+  }
+
+  nlohmann::json out = {
+      {"study",
+       {{"series", spec.series},
+        {"slicesPerSeries", spec.slicesPerSeries},
+        {"rows", spec.rows},
+        {"columns", spec.columns},
+        {"seed", spec.seed}}},
+      {"results", benchResultsToJSON(results)}};
+  std::cout << out.dump(2) << std::endl;
+  return 0;
+}
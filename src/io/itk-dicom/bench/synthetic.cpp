@@ -0,0 +1,186 @@
+#include <cerrno>
+#include <cmath>
+#include <fstream>
+#include <stdexcept>
+#include <sys/stat.h>
+
+#include "itkGDCMImageIO.h"
+#include "itkImage.h"
+#include "itkImageFileWriter.h"
+#include "itkMetaDataObject.h"
+
+#include "synthetic.hpp"
+
+namespace {
+
+using SliceImageType = itk::Image<int16_t, 3>;
+
+// row cosine, column cosine
+const double Orientations[3][6] = {
+    {1, 0, 0, 0, 1, 0},  // axial
+    {1, 0, 0, 0, 0, -1}, // coronal
+    {0, 1, 0, 0, 0, -1}, // sagittal
+};
+
+// PatientName in each charset of SyntheticStudySpec::charsets
+std::string patientName(const std::string &charset) {
+  if (charset == "ISO_IR 100") {
+    return "Buc\xe9^J\xe9r\xf4me";
+  }
+  if (charset == "ISO_IR 144") {
+    return "\xbb\xee\xda\x65\xdc\xd5\xe0\xd3\xd5\xe0";
+  }
+  if (charset == "\\ISO 2022 IR 87") {
+    return "Yamada^Tarou=\x1b$B;3ED\x1b(B^\x1b$BB@O:\x1b(B";
+  }
+  return "Doe^John";
+}
+
+// Fills a slice with a smooth body-like blob plus seeded noise, so the
+// pixel data neither compresses away nor is constant.
+void fillSlice(SliceImageType *image, const SyntheticStudySpec &spec,
+               unsigned series, unsigned slice) {
+  uint32_t state = spec.seed * 2654435761u ^ (series << 16) ^ slice;
+  int16_t *pixels = image->GetBufferPointer();
+  const double cx = spec.columns / 2.0;
+  const double cy = spec.rows / 2.0;
+  const double radius = std::min(cx, cy) * (0.6 + 0.2 * std::sin(0.1 * slice));
+
+  for (unsigned y = 0; y < spec.rows; y++) {
+    for (unsigned x = 0; x < spec.columns; x++) {
+      // xorshift32
+      state ^= state << 13;
+      state ^= state >> 17;
+      state ^= state << 5;
+      const double d = std::hypot(x - cx, y - cy) / radius;
+      const int body = d < 1 ? 1000 + int(200 * (1 - d)) : 0;
+      *pixels++ = int16_t(body + int(state % 32) - 16);
+    }
+  }
+}
+
+} // namespace
+
+std::vector<std::string> writeSyntheticStudy(const std::string &dir,
+                                             const SyntheticStudySpec &spec) {
+  if (mkdir(dir.c_str(), 0777) != 0 && errno != EEXIST) {
+    throw std::runtime_error("Cannot create " + dir);
+  }
+
+  SliceImageType::Pointer image = SliceImageType::New();
+  SliceImageType::SizeType size;
+  size[0] = spec.columns;
+  size[1] = spec.rows;
+  size[2] = 1;
+  image->SetRegions(size);
+  image->Allocate();
+
+  SliceImageType::SpacingType spacing;
+  spacing[0] = spacing[1] = 0.7;
+  spacing[2] = 1.25;
+  image->SetSpacing(spacing);
+
+  using WriterType = itk::ImageFileWriter<SliceImageType>;
+  WriterType::Pointer writer = WriterType::New();
+  itk::GDCMImageIO::Pointer dicomIO = itk::GDCMImageIO::New();
+  // write our UIDs, so the corpus is the same on every run
+  dicomIO->KeepOriginalUIDOn();
+  writer->SetImageIO(dicomIO);
+  writer->SetInput(image);
+
+  const std::string uidRoot =
+      "1.2.826.0.1.3680043.9.7539." + std::to_string(spec.seed);
+  const unsigned orientations = std::max(1u, std::min(3u, spec.orientations));
+  std::vector<std::string> filenames;
+
+  for (unsigned series = 0; series < spec.series; series++) {
+    const std::string charset =
+        spec.charsets.empty() ? ""
+                              : spec.charsets[series % spec.charsets.size()];
+    const std::string seriesUID = uidRoot + ".1." + std::to_string(series + 1);
+
+    for (unsigned slice = 0; slice < spec.slicesPerSeries; slice++) {
+      unsigned orientation = series % orientations;
+      if (series < spec.mixedOrientationSeries &&
+          slice >= spec.slicesPerSeries / 2) {
+        orientation = (orientation + 1) % 3;
+      }
+      const double *cosines = Orientations[orientation];
+
+      // columns of the direction matrix: row, column and slice normal
+      SliceImageType::DirectionType direction;
+      const double normal[3] = {
+          cosines[1] * cosines[5] - cosines[2] * cosines[4],
+          cosines[2] * cosines[3] - cosines[0] * cosines[5],
+          cosines[0] * cosines[4] - cosines[1] * cosines[3]};
+      SliceImageType::PointType origin;
+      for (unsigned i = 0; i < 3; i++) {
+        direction[i][0] = cosines[i];
+        direction[i][1] = cosines[3 + i];
+        direction[i][2] = normal[i];
+        origin[i] = -90.0 + slice * spacing[2] * normal[i];
+      }
+      image->SetDirection(direction);
+      image->SetOrigin(origin);
+      fillSlice(image, spec, series, slice);
+
+      // the writer hands the image's dictionary to GDCMImageIO
+      itk::MetaDataDictionary &dict = image->GetMetaDataDictionary();
+      auto set = [&](const char *tag, const std::string &value) {
+        itk::EncapsulateMetaData<std::string>(dict, tag, value);
+      };
+      set("0008|0005", charset);
+      set("0008|0016", "1.2.840.10008.5.1.4.1.1.2"); // CT Image Storage
+      set("0008|0018", seriesUID + "." + std::to_string(slice + 1));
+      set("0008|0060", "CT");
+      set("0008|103e", "Synthetic series " + std::to_string(series + 1));
+      set("0010|0010", patientName(charset));
+      set("0010|0020", "BENCH" + std::to_string(spec.seed));
+      set("0020|000d", uidRoot + ".0");
+      set("0020|000e", seriesUID);
+      set("0020|0011", std::to_string(series + 1));
+      set("0020|0013", std::to_string(slice + 1));
+      set("0028|1050", "40");
+      set("0028|1051", "400");
+
+      const std::string filename = dir + "/s" + std::to_string(series + 1) +
+                                   "_" + std::to_string(slice + 1) + ".dcm";
+      writer->SetFileName(filename);
+      writer->Update();
+      filenames.push_back(filename);
+    }
+  }
+
+  return filenames;
+}
+
+void writeSyntheticTRE(const std::string &filename, unsigned tubes,
+                       unsigned pointsPerTube) {
+  std::ofstream out(filename);
+  if (!out) {
+    throw std::runtime_error("Cannot write " + filename);
+  }
+
+  out << "ObjectType = Scene\n"
+      << "NDims = 3\n"
+      << "NObjects = " << tubes << "\n";
+
+  for (unsigned t = 0; t < tubes; t++) {
+    out << "ObjectType = Tube\n"
+        << "NDims = 3\n"
+        << "ID = " << t + 1 << "\n"
+        << "ParentID = -1\n"
+        << "Color = 1 0 0 1\n"
+        << "PointDim = x y z r red green blue alpha id\n"
+        << "NPoints = " << pointsPerTube << "\n"
+        << "Points = \n";
+
+    // a helix per tube, so coordinates are not trivially repetitive
+    for (unsigned p = 0; p < pointsPerTube; p++) {
+      const double angle = 0.05 * p + t;
+      out << 100 + 20 * std::cos(angle) << ' ' << 100 + 20 * std::sin(angle)
+          << ' ' << 0.1 * p << ' ' << 1.0 + 0.5 * std::sin(0.01 * p) << ' '
+          << "1 0 0 1 " << p << '\n';
+    }
+  }
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * Shape of a synthetic DICOM study. The same spec and seed always produce
+ * the same files.
+ */
+struct SyntheticStudySpec {
+  unsigned series = 4;
+  unsigned slicesPerSeries = 32;
+  unsigned rows = 256;
+  unsigned columns = 256;
+  // Series cycle through axial, coronal and sagittal slices, using the first
+  // `orientations` of them.
+  unsigned orientations = 3;
+  // The first this many series switch orientation halfway, like a series
+  // that holds its own localizer, so import has to split them.
+  unsigned mixedOrientationSeries = 1;
+  // Series cycle through these SpecificCharacterSet values, with a
+  // PatientName encoded in each.
+  std::vector<std::string> charsets = {"", "ISO_IR 100", "ISO_IR 144",
+                                       "\\ISO 2022 IR 87"};
+  uint32_t seed = 1;
+};
+
+/**
+ * Writes a CT study of 16-bit slices into dir, which is created if needed.
+ * Returns the filenames, series by series in slice order.
+ */
+std::vector<std::string> writeSyntheticStudy(const std::string &dir,
+                                             const SyntheticStudySpec &spec);
+
+/**
+ * Writes a text TRE file with `tubes` sibling tubes of `pointsPerTube`
+ * points each, shaped like a vessel tree export.
+ */
+void writeSyntheticTRE(const std::string &filename, unsigned tubes,
+                       unsigned pointsPerTube);
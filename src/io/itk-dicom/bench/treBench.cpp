@@ -0,0 +1,48 @@
+#include <cstdio>
+#include <string>
+
+#include "../binaryResult.hpp"
+#include "../readTRE.hpp"
+#include "../treParser.hpp"
+#include "benchmark.hpp"
+#include "synthetic.hpp"
+
+void treBenchmarks(BenchResults &results) {
+  const std::string treFile = "dicom_bench_tubes.tre";
+  const std::string outFile = "dicom_bench_tubes.out";
+  // 1M points, about what a whole-lung vessel segmentation has
+  writeSyntheticTRE(treFile, 1000, 1000);
+
+  runBenchmark(
+      results, "tre/json",
+      [&] { benchSink(readTRE(treFile).dump().size()); }, 0);
+
+  runBenchmark(
+      results, "tre/arrays",
+      [&] {
+        TubeTree tree = readTubeTree(treFile);
+        BinaryResult binary;
+        binary.addArray("positions", tree.positions);
+        binary.addArray("radii", tree.radii);
+        binary.addArray("colors", tree.colors);
+        binary.write(outFile);
+        benchSink(tree.pointIds.size());
+      },
+      0);
+
+  runBenchmark(
+      results, "tre/stream",
+      [&] {
+        TubeTree tree = parseTubeTree(treFile);
+        BinaryResult binary;
+        binary.addArray("positions", tree.positions);
+        binary.addArray("radii", tree.radii);
+        binary.addArray("colors", tree.colors);
+        binary.write(outFile);
+        benchSink(tree.pointIds.size());
+      },
+      0);
+
+  std::remove(treFile.c_str());
+  std::remove(outFile.c_str());
+}
@@ -0,0 +1,98 @@
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#include "binaryResult.hpp"
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#error "BinaryResult writes host byte order, which must be little-endian"
+#endif
+
+namespace {
+
+constexpr size_t HeaderSize = 16;
+constexpr size_t DirectoryEntrySize = 32;
+
+size_t align8(size_t offset) { return (offset + 7) & ~size_t(7); }
+
+template <typename T> void put(std::vector<char> &out, size_t pos, T value) {
+  std::memcpy(out.data() + pos, &value, sizeof(T));
+}
+
+} // namespace
+
+void BinaryResult::addColumn(const std::string &name, ColumnType type,
+                             size_t count, const void *data, size_t length) {
+  Column column{name, type, static_cast<uint32_t>(count), {}};
+  const char *bytes = static_cast<const char *>(data);
+  column.data.assign(bytes, bytes + length);
+  m_columns.push_back(std::move(column));
+}
+
+void BinaryResult::addStrings(const std::string &name,
+                              const std::vector<std::string> &values) {
+  Column column{name, String, static_cast<uint32_t>(values.size()), {}};
+
+  std::vector<uint32_t> offsets(1, 0);
+  for (const auto &value : values) {
+    offsets.push_back(offsets.back() + value.size());
+  }
+  const size_t offsetsLength = offsets.size() * sizeof(uint32_t);
+  column.data.resize(offsetsLength + offsets.back());
+  std::memcpy(column.data.data(), offsets.data(), offsetsLength);
+  for (size_t i = 0; i < values.size(); i++) {
+    std::memcpy(column.data.data() + offsetsLength + offsets[i],
+                values[i].data(), values[i].size());
+  }
+
+  m_columns.push_back(std::move(column));
+}
+
+void BinaryResult::write(const std::string &filename) const {
+  // lay out names right after the directory, then the 8-aligned columns
+  size_t offset = HeaderSize + DirectoryEntrySize * m_columns.size();
+  std::vector<size_t> nameOffsets, dataOffsets;
+  for (const auto &column : m_columns) {
+    nameOffsets.push_back(offset);
+    offset += column.name.size();
+  }
+  for (const auto &column : m_columns) {
+    offset = align8(offset);
+    dataOffsets.push_back(offset);
+    offset += column.data.size();
+  }
+
+  // header, directory and names go out in one block, then each column
+  std::vector<char> head(nameOffsets.empty() ? HeaderSize
+                                             : dataOffsets.front(),
+                         0);
+  std::memcpy(head.data(), Magic, sizeof(Magic));
+  put<uint32_t>(head, 4, Version);
+  put<uint32_t>(head, 8, m_columns.size());
+
+  for (size_t i = 0; i < m_columns.size(); i++) {
+    const Column &column = m_columns[i];
+    const size_t entry = HeaderSize + i * DirectoryEntrySize;
+    put<uint32_t>(head, entry, nameOffsets[i]);
+    put<uint32_t>(head, entry + 4, column.name.size());
+    put<uint32_t>(head, entry + 8, column.type);
+    put<uint32_t>(head, entry + 12, column.count);
+    put<uint64_t>(head, entry + 16, dataOffsets[i]);
+    put<uint64_t>(head, entry + 24, column.data.size());
+    std::memcpy(head.data() + nameOffsets[i], column.name.data(),
+                column.name.size());
+  }
+
+  std::ofstream file(filename, std::ios::binary);
+  file.write(head.data(), head.size());
+  size_t written = head.size();
+  for (size_t i = 0; i < m_columns.size(); i++) {
+    const char padding[8] = {};
+    file.write(padding, dataOffsets[i] - written);
+    file.write(m_columns[i].data.data(), m_columns[i].data.size());
+    written = dataOffsets[i] + m_columns[i].data.size();
+  }
+  if (!file) {
+    throw std::runtime_error("Failed to write result to " + filename);
+  }
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+/**
+ * A set of named, typed columns written as one flat little-endian file, so
+ * the JS side can view numeric columns as typed arrays without parsing.
+ *
+ * Layout (all integers little-endian):
+ *
+ *   header     char magic[4] = "PVMB", uint32 version, uint32 columnCount,
+ *              uint32 reserved
+ *   directory  columnCount entries of
+ *                uint32 nameOffset, uint32 nameLength, uint32 type,
+ *                uint32 count, uint64 dataOffset, uint64 dataLength
+ *   data       column names and column data. Offsets are from the start of
+ *              the file, and column data starts on an 8-byte boundary.
+ *
+ * Numeric columns hold `count` values. String columns hold count + 1
+ * uint32 offsets followed by the UTF-8 bytes of all strings; string i spans
+ * [offsets[i], offsets[i + 1]) relative to the end of the offsets.
+ */
+class BinaryResult {
+public:
+  enum ColumnType : uint32_t {
+    UInt8 = 1,
+    Int32 = 2,
+    UInt32 = 3,
+    Float32 = 4,
+    Float64 = 5,
+    String = 6,
+  };
+
+  static constexpr char Magic[4] = {'P', 'V', 'M', 'B'};
+  static constexpr uint32_t Version = 1;
+
+  void addStrings(const std::string &name,
+                  const std::vector<std::string> &values);
+
+  template <typename T>
+  void addArray(const std::string &name, const std::vector<T> &values) {
+    this->addColumn(name, columnType<T>(), values.size(), values.data(),
+                    values.size() * sizeof(T));
+  }
+
+  // Throws std::runtime_error if the file cannot be written.
+  void write(const std::string &filename) const;
+
+private:
+  struct Column {
+    std::string name;
+    ColumnType type;
+    uint32_t count;
+    std::vector<char> data;
+  };
+
+  template <typename T> static constexpr ColumnType columnType() {
+    if constexpr (std::is_same_v<T, uint8_t>) {
+      return UInt8;
+    } else if constexpr (std::is_same_v<T, int32_t>) {
+      return Int32;
+    } else if constexpr (std::is_same_v<T, uint32_t>) {
+      return UInt32;
+    } else if constexpr (std::is_same_v<T, float>) {
+      return Float32;
+    } else {
+      static_assert(std::is_same_v<T, double>, "unsupported column type");
+      return Float64;
+    }
+  }
+
+  void addColumn(const std::string &name, ColumnType type, size_t count,
+                 const void *data, size_t length);
+
+  std::vector<Column> m_columns;
+};
@@ -1,16 +1,23 @@
 #include <iostream>
 
 #include <algorithm>
+#include <iterator>
 #include <memory>
 #include <sstream>
 #include <stdexcept>
 #include <string.h>
 #include <string>
+#include <string_view>
 #include <vector>
 
-#include <iconv.h>
-
 #include "charset.hpp"
+#include "singleByteCharsets.hpp"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__wasm_simd128__)
+#include <wasm_simd128.h>
+#endif
 
 const std::string DEFAULT_ENCODING("ISO_IR 6");
 const std::string DEFAULT_ISO_2022_ENCODING("ISO 2022 IR 6");
@@ -35,6 +42,36 @@ size_t findDelim(const char *str, size_t len, size_t pos = 0,
   return pos;
 }
 
+// True if no byte has its high bit set. Checks 16 bytes at a time with
+// SSE2 or wasm simd128 when available, then 8 bytes at a time.
+bool isAscii(const char *str, size_t len) {
+  size_t i = 0;
+#if defined(__SSE2__)
+  for (; i + 16 <= len; i += 16) {
+    __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(str + i));
+    if (_mm_movemask_epi8(chunk) != 0) {
+      return false;
+    }
+  }
+#elif defined(__wasm_simd128__)
+  for (; i + 16 <= len; i += 16) {
+    if (wasm_i8x16_bitmask(wasm_v128_load(str + i)) != 0) {
+      return false;
+    }
+  }
+#endif
+  uint64_t bits = 0;
+  for (; i + 8 <= len; i += 8) {
+    uint64_t word;
+    memcpy(&word, str + i, sizeof(word));
+    bits |= word;
+  }
+  for (; i < len; i++) {
+    bits |= static_cast<unsigned char>(str[i]);
+  }
+  return (bits & 0x8080808080808080ull) == 0;
+}
+
 std::string trimWhitespace(const std::string &term) {
   auto start = term.begin();
   auto end = term.end();
@@ -55,71 +92,71 @@ std::string normalizeTerm(const std::string &term) {
   return trimWhitespace(term);
 }
 
-const char *definedTermToIconvCharset(const std::string &defTerm) {
-  // be strict about comparing defined terms, so no fancy parsing
-  // that could possibly make these operations faster.
-  // See:
-  // http://dicom.nema.org/medical/dicom/current/output/chtml/part02/sect_D.6.2.html
-  if (defTerm == "ISO_IR 6" || defTerm == "ISO 2022 IR 6") {
-    return ASCII;
-  }
-  if (defTerm == "ISO_IR 100" || defTerm == "ISO 2022 IR 100") {
-    return "ISO-8859-1"; // Latin 1
-  }
-  if (defTerm == "ISO_IR 101" || defTerm == "ISO 2022 IR 101") {
-    return "ISO-8859-2"; // Latin 2
-  }
-  if (defTerm == "ISO_IR 109" || defTerm == "ISO 2022 IR 109") {
-    return "ISO-8859-3"; // Latin 3
-  }
-  if (defTerm == "ISO_IR 110" || defTerm == "ISO 2022 IR 110") {
-    return "ISO-8859-4"; // Latin 4
-  }
-  if (defTerm == "ISO_IR 144" || defTerm == "ISO 2022 IR 144") {
-    return "ISO-8859-5"; // Cyrillic
-  }
-  if (defTerm == "ISO_IR 127" || defTerm == "ISO 2022 IR 127") {
-    return "ISO-8859-6"; // Arabic
-  }
-  if (defTerm == "ISO_IR 126" || defTerm == "ISO 2022 IR 126") {
-    return "ISO-8859-7"; // Greek
-  }
-  if (defTerm == "ISO_IR 138" || defTerm == "ISO 2022 IR 138") {
-    return "ISO-8859-8"; // Hebrew
-  }
-  if (defTerm == "ISO_IR 148" || defTerm == "ISO 2022 IR 148") {
-    return "ISO-8859-9"; // Latin 5, Turkish
-  }
-  if (defTerm == "ISO_IR 13" || defTerm == "ISO 2022 IR 13") {
+struct DefinedTerm {
+  std::string_view term;
+  const char *iconvCharset;
+};
+
+// Sorted by term so lookups can binary search. Terms are compared exactly,
+// with no fancy parsing.
+// See:
+// http://dicom.nema.org/medical/dicom/current/output/chtml/part02/sect_D.6.2.html
+constexpr DefinedTerm DEFINED_TERMS[] = {
+    {"GB18030", "GB18030"},
+    {"GBK", "GBK"},
+    {"ISO 2022 IR 100", "ISO-8859-1"}, // Latin 1
+    {"ISO 2022 IR 101", "ISO-8859-2"}, // Latin 2
+    {"ISO 2022 IR 109", "ISO-8859-3"}, // Latin 3
+    {"ISO 2022 IR 110", "ISO-8859-4"}, // Latin 4
+    {"ISO 2022 IR 126", "ISO-8859-7"}, // Greek
+    {"ISO 2022 IR 127", "ISO-8859-6"}, // Arabic
     // while technically not strict, SHIFT_JIS succeeds JIS X 0201
     // See: https://en.wikipedia.org/wiki/JIS_X_0201
-    return "SHIFT_JIS"; // Japanese
-  }
-  if (defTerm == "ISO_IR 166" || defTerm == "ISO 2022 IR 166") {
-    return "TIS-620"; // Thai
-  }
-  if (defTerm == "ISO 2022 IR 87") {
-    // see: https://en.wikipedia.org/wiki/JIS_X_0208
-    return "ISO-2022-JP"; // Japanese
-  }
-  if (defTerm == "ISO 2022 IR 159") {
+    {"ISO 2022 IR 13", "SHIFT_JIS"},   // Japanese
+    {"ISO 2022 IR 138", "ISO-8859-8"}, // Hebrew
+    {"ISO 2022 IR 144", "ISO-8859-5"}, // Cyrillic
+    {"ISO 2022 IR 148", "ISO-8859-9"}, // Latin 5, Turkish
+    {"ISO 2022 IR 149", "EUC-KR"},     // Korean
     // see: https://en.wikipedia.org/wiki/JIS_X_0212
-    return "ISO-2022-JP-1"; // Japanese
-  }
-  if (defTerm == "ISO 2022 IR 149") {
-    return "EUC-KR"; // Korean
-  }
-  if (defTerm == "ISO 2022 IR 58") {
-    return "EUC-CN"; // Chinese
-  }
-  if (defTerm == "ISO_IR 192") {
-    return "UTF-8";
-  }
-  if (defTerm == "GB18030") {
-    return "GB18030";
+    {"ISO 2022 IR 159", "ISO-2022-JP-1"}, // Japanese
+    {"ISO 2022 IR 166", "TIS-620"},       // Thai
+    {"ISO 2022 IR 58", "EUC-CN"},         // Chinese
+    {"ISO 2022 IR 6", ASCII},
+    // see: https://en.wikipedia.org/wiki/JIS_X_0208
+    {"ISO 2022 IR 87", "ISO-2022-JP"}, // Japanese
+    {"ISO_IR 100", "ISO-8859-1"},      // Latin 1
+    {"ISO_IR 101", "ISO-8859-2"},      // Latin 2
+    {"ISO_IR 109", "ISO-8859-3"},      // Latin 3
+    {"ISO_IR 110", "ISO-8859-4"},      // Latin 4
+    {"ISO_IR 126", "ISO-8859-7"},      // Greek
+    {"ISO_IR 127", "ISO-8859-6"},      // Arabic
+    {"ISO_IR 13", "SHIFT_JIS"},        // Japanese
+    {"ISO_IR 138", "ISO-8859-8"},      // Hebrew
+    {"ISO_IR 144", "ISO-8859-5"},      // Cyrillic
+    {"ISO_IR 148", "ISO-8859-9"},      // Latin 5, Turkish
+    {"ISO_IR 166", "TIS-620"},         // Thai
+    {"ISO_IR 192", "UTF-8"},
+    {"ISO_IR 6", ASCII},
+};
+
+constexpr bool definedTermsSorted() {
+  for (size_t i = 1; i < std::size(DEFINED_TERMS); i++) {
+    if (!(DEFINED_TERMS[i - 1].term < DEFINED_TERMS[i].term)) {
+      return false;
+    }
   }
-  if (defTerm == "GBK") {
-    return "GBK";
+  return true;
+}
+static_assert(definedTermsSorted(), "DEFINED_TERMS must be sorted by term");
+
+const char *definedTermToIconvCharset(std::string_view defTerm) {
+  auto found = std::lower_bound(
+      std::begin(DEFINED_TERMS), std::end(DEFINED_TERMS), defTerm,
+      [](const DefinedTerm &entry, std::string_view term) {
+        return entry.term < term;
+      });
+  if (found != std::end(DEFINED_TERMS) && found->term == defTerm) {
+    return found->iconvCharset;
   }
   return nullptr;
 }
@@ -200,6 +237,61 @@ CharStringToUTF8Converter::CharStringToUTF8Converter(const char *spcharsets)
   this->setSpecificCharacterSet(spcharsets);
 }
 
+CharStringToUTF8Converter::~CharStringToUTF8Converter() {
+  this->closeDescriptors();
+}
+
+CharStringToUTF8Converter::CharStringToUTF8Converter(
+    CharStringToUTF8Converter &&other) noexcept
+    : m_charsets(std::move(other.m_charsets)),
+      handlePatientName(other.handlePatientName),
+      useFastPath(other.useFastPath),
+      m_asciiCompatible(other.m_asciiCompatible),
+      m_singleByteTable(other.m_singleByteTable),
+      m_descriptors(std::move(other.m_descriptors)),
+      m_buffer(std::move(other.m_buffer)) {
+  other.m_descriptors.clear();
+}
+
+CharStringToUTF8Converter &CharStringToUTF8Converter::operator=(
+    CharStringToUTF8Converter &&other) noexcept {
+  if (this != &other) {
+    this->closeDescriptors();
+    m_charsets = std::move(other.m_charsets);
+    handlePatientName = other.handlePatientName;
+    useFastPath = other.useFastPath;
+    m_asciiCompatible = other.m_asciiCompatible;
+    m_singleByteTable = other.m_singleByteTable;
+    m_descriptors = std::move(other.m_descriptors);
+    m_buffer = std::move(other.m_buffer);
+    other.m_descriptors.clear();
+  }
+  return *this;
+}
+
+iconv_t CharStringToUTF8Converter::descriptor(const char *charset) {
+  for (const auto &[name, cd] : m_descriptors) {
+    if (0 == strcmp(name, charset)) {
+      // back to the initial shift state
+      iconv(cd, nullptr, nullptr, nullptr, nullptr);
+      return cd;
+    }
+  }
+
+  iconv_t cd = iconv_open("UTF-8", charset);
+  if (cd != (iconv_t)-1) {
+    m_descriptors.emplace_back(charset, cd);
+  }
+  return cd;
+}
+
+void CharStringToUTF8Converter::closeDescriptors() {
+  for (const auto &entry : m_descriptors) {
+    iconv_close(entry.second);
+  }
+  m_descriptors.clear();
+}
+
 void CharStringToUTF8Converter::setSpecificCharacterSet(
     const char *spcharsets) {
   std::string specificCharacterSet(spcharsets);
@@ -249,6 +341,14 @@ void CharStringToUTF8Converter::setSpecificCharacterSet(
   if (m_charsets.size() == 0) {
     std::cerr << "WARN: Found no suitable charsets!" << std::endl;
   }
+
+  const char *initialCharset =
+      m_charsets.empty() ? nullptr : definedTermToIconvCharset(m_charsets[0]);
+  // SHIFT_JIS maps 0x5C and 0x7E to YEN SIGN and OVERLINE
+  m_asciiCompatible =
+      initialCharset != nullptr && 0 != strcmp(initialCharset, "SHIFT_JIS");
+  m_singleByteTable =
+      initialCharset ? singleByteCharsetTable(initialCharset) : nullptr;
 }
 
 std::string
@@ -265,21 +365,36 @@ std::string CharStringToUTF8Converter::convertCharStringToUTF8(const char *str,
     return {};
   }
 
-  iconv_t cd = iconv_open("UTF-8", initialCharset);
+  // Without escapes the whole string is in the initial charset, since
+  // delimiters only switch back to it.
+  if (this->useFastPath && memchr(str, 0x1b, len) == nullptr) {
+    // output stops at the first NULL byte, as padding may be NULL
+    size_t textLen = strnlen(str, len);
+    if (m_asciiCompatible && isAscii(str, textLen)) {
+      return std::string(str, textLen);
+    }
+    std::string result;
+    if (m_singleByteTable &&
+        transcodeSingleByte(m_singleByteTable, str, textLen, result)) {
+      return result;
+    }
+  }
+
+  iconv_t cd = this->descriptor(initialCharset);
   if (cd == (iconv_t)-1) {
     return {};
   }
 
-  int utf8len = len * 4;
-  std::unique_ptr<char[]> result(
-      new char[utf8len + 1]()); // UTF8 will have max length of utf8len
-
-  // make a copy because iconv requires a char *
-  char *copiedStr = (char *)malloc(len + 1);
-  strncpy(copiedStr, str, len);
+  // UTF8 will have max length of len * 4
+  size_t utf8len = len * 4;
+  if (m_buffer.size() < utf8len) {
+    m_buffer.resize(utf8len);
+  }
 
-  char *inbuf = copiedStr;
-  char *outbuf = result.get();
+  // iconv takes a char ** but does not write to the input
+  char *input = const_cast<char *>(str);
+  char *inbuf = input;
+  char *outbuf = m_buffer.data();
   size_t inbytesleft = len;
   size_t outbytesleft = utf8len;
 
@@ -295,23 +410,25 @@ std::string CharStringToUTF8Converter::convertCharStringToUTF8(const char *str,
           this->handlePatientName ? PATIENT_NAME_DELIMS : DEFAULT_DELIMS;
       // fragmentEnd will always be end of current fragment (exclusive end)
       fragmentEnd = findDelim(str, len, fragmentStart + 1, delims);
-      inbuf = copiedStr + fragmentStart;
+      inbuf = input + fragmentStart;
       inbytesleft = fragmentEnd - fragmentStart;
 
       iconv(cd, &inbuf, &inbytesleft, &outbuf, &outbytesleft);
 
       fragmentStart = fragmentEnd;
-      bool isEsc = str[fragmentEnd] == 0x1b;
 
       if (fragmentStart < len) {
         const char *nextCharset;
         int seek = 0;
 
-        if (isEsc) { // case: ISO 2022 escape encountered
-          const char *escSeq = copiedStr + fragmentStart + 1;
+        if (str[fragmentStart] == 0x1b) { // case: ISO 2022 escape encountered
+          // escape sequences are at most 3 bytes after ESC
+          char escSeq[4] = {};
+          memcpy(escSeq, str + fragmentStart + 1,
+                 std::min<size_t>(3, len - fragmentStart - 1));
 
           const char *nextTerm = iso2022EscSelectCharset(escSeq);
-          nextCharset = definedTermToIconvCharset(std::string(nextTerm));
+          nextCharset = definedTermToIconvCharset(nextTerm);
           if (nextCharset == nullptr ||
               m_charsets.end() ==
                   std::find(m_charsets.begin(), m_charsets.end(), nextTerm)) {
@@ -333,11 +450,7 @@ std::string CharStringToUTF8Converter::convertCharStringToUTF8(const char *str,
           nextCharset = initialCharset;
         }
 
-        if (0 != iconv_close(cd)) {
-          std::cerr << "WARN: bailing because iconv_close" << std::endl;
-          break; // bail out
-        }
-        cd = iconv_open("UTF-8", nextCharset);
+        cd = this->descriptor(nextCharset);
         if (cd == (iconv_t)-1) {
           std::cerr << "WARN: bailing because iconv_open" << std::endl;
           break; // bail out
@@ -348,10 +461,8 @@ std::string CharStringToUTF8Converter::convertCharStringToUTF8(const char *str,
     }
   }
 
-  free(copiedStr);
-  iconv_close(cd);
-
-  // since result is filled with NULL bytes, string constructor will figure out
-  // the correct string ending.
-  return std::string(result.get());
+  // stop at the first NULL byte, as padding may be NULL
+  const char *result = m_buffer.data();
+  size_t resultLen = outbuf - result;
+  return std::string(result, strnlen(result, resultLen));
 }
@@ -1,11 +1,24 @@
+#include <cstdint>
 #include <string>
+#include <utility>
 #include <vector>
 
+#include <iconv.h>
+
 class CharStringToUTF8Converter {
 public:
   // See: setSpecificCharacterSet(const char *)
   CharStringToUTF8Converter(const std::string &spcharsets);
   CharStringToUTF8Converter(const char *spcharsets);
+  ~CharStringToUTF8Converter();
+
+  // owns iconv descriptors, so it can only be moved
+  CharStringToUTF8Converter(CharStringToUTF8Converter &&other) noexcept;
+  CharStringToUTF8Converter &
+  operator=(CharStringToUTF8Converter &&other) noexcept;
+  CharStringToUTF8Converter(const CharStringToUTF8Converter &) = delete;
+  CharStringToUTF8Converter &
+  operator=(const CharStringToUTF8Converter &) = delete;
 
   /**
    * Input must be the DICOM SpecificCharacterSet element value.
@@ -21,7 +34,30 @@ public:
 
   void setHandlePatientName(bool yn) { this->handlePatientName = yn; }
 
+  /**
+   * When on (the default), strings without ISO 2022 escapes skip iconv if
+   * they are pure ASCII in an ASCII-compatible charset, or if the charset
+   * is single-byte. Off routes everything through iconv, for comparison.
+   */
+  void setUseFastPath(bool yn) { this->useFastPath = yn; }
+
 private:
+  // Returns an open descriptor converting from the iconv charset to UTF-8,
+  // in its initial shift state. Descriptors stay open for the lifetime of
+  // the converter.
+  iconv_t descriptor(const char *charset);
+  void closeDescriptors();
+
   std::vector<std::string> m_charsets;
   bool handlePatientName;
+  bool useFastPath = true;
+
+  // properties of the initial charset, for the fast path
+  bool m_asciiCompatible = false;
+  const uint16_t *m_singleByteTable = nullptr;
+
+  // open descriptors, keyed by iconv charset name
+  std::vector<std::pair<const char *, iconv_t>> m_descriptors;
+  // reused output buffer
+  std::vector<char> m_buffer;
 };
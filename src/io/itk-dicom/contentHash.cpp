@@ -0,0 +1,110 @@
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+#include "contentHash.hpp"
+#include "trace.hpp"
+
+namespace {
+
+constexpr uint64_t Prime1 = 0x9E3779B185EBCA87ull;
+constexpr uint64_t Prime2 = 0xC2B2AE3D27D4EB4Full;
+constexpr uint64_t Prime3 = 0x165667B19E3779F9ull;
+constexpr uint64_t Prime4 = 0x85EBCA77C2B2AE63ull;
+constexpr uint64_t Prime5 = 0x27D4EB2F165667C5ull;
+
+uint64_t rotl(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+
+// xxHash reads little-endian words; so does every target we build for
+uint64_t read64(const unsigned char *p) {
+  uint64_t value;
+  std::memcpy(&value, p, sizeof(value));
+  return value;
+}
+
+uint32_t read32(const unsigned char *p) {
+  uint32_t value;
+  std::memcpy(&value, p, sizeof(value));
+  return value;
+}
+
+uint64_t xxRound(uint64_t acc, uint64_t input) {
+  acc += input * Prime2;
+  return rotl(acc, 31) * Prime1;
+}
+
+uint64_t mergeRound(uint64_t acc, uint64_t value) {
+  acc ^= xxRound(0, value);
+  return acc * Prime1 + Prime4;
+}
+
+} // namespace
+
+uint64_t xxh64(const void *data, size_t length, uint64_t seed) {
+  const unsigned char *p = static_cast<const unsigned char *>(data);
+  const unsigned char *end = p + length;
+  uint64_t hash;
+
+  if (length >= 32) {
+    // four independent lanes over 32-byte stripes
+    uint64_t v1 = seed + Prime1 + Prime2;
+    uint64_t v2 = seed + Prime2;
+    uint64_t v3 = seed;
+    uint64_t v4 = seed - Prime1;
+    const unsigned char *limit = end - 32;
+    do {
+      v1 = xxRound(v1, read64(p));
+      v2 = xxRound(v2, read64(p + 8));
+      v3 = xxRound(v3, read64(p + 16));
+      v4 = xxRound(v4, read64(p + 24));
+      p += 32;
+    } while (p <= limit);
+
+    hash = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+    hash = mergeRound(hash, v1);
+    hash = mergeRound(hash, v2);
+    hash = mergeRound(hash, v3);
+    hash = mergeRound(hash, v4);
+  } else {
+    hash = seed + Prime5;
+  }
+
+  hash += length;
+
+  for (; p + 8 <= end; p += 8) {
+    hash ^= xxRound(0, read64(p));
+    hash = rotl(hash, 27) * Prime1 + Prime4;
+  }
+  if (p + 4 <= end) {
+    hash ^= uint64_t(read32(p)) * Prime1;
+    hash = rotl(hash, 23) * Prime2 + Prime3;
+    p += 4;
+  }
+  for (; p < end; p++) {
+    hash ^= *p * Prime5;
+    hash = rotl(hash, 11) * Prime1;
+  }
+
+  // avalanche
+  hash ^= hash >> 33;
+  hash *= Prime2;
+  hash ^= hash >> 29;
+  hash *= Prime3;
+  hash ^= hash >> 32;
+  return hash;
+}
+
+bool hashFile(const std::string &filename, uint64_t &hash) {
+  std::ifstream file(filename, std::ios::binary | std::ios::ate);
+  if (!file) {
+    return false;
+  }
+  std::vector<char> bytes(static_cast<size_t>(file.tellg()));
+  file.seekg(0);
+  if (!file.read(bytes.data(), bytes.size())) {
+    return false;
+  }
+  traceFileRead(bytes.size());
+  hash = xxh64(bytes.data(), bytes.size());
+  return true;
+}
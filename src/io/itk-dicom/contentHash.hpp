@@ -0,0 +1,16 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/**
+ * XXH64 of a buffer, as in the reference xxHash implementation, so hashes
+ * can be checked against other tools.
+ */
+uint64_t xxh64(const void *data, size_t length, uint64_t seed = 0);
+
+/**
+ * XXH64 of a whole file. Returns false if the file cannot be read.
+ */
+bool hashFile(const std::string &filename, uint64_t &hash);
@@ -1,8 +1,12 @@
+#include <algorithm>
 #include <cerrno>
 #include <cstdio>
 #include <dirent.h>
 #include <fstream>
 #include <iostream>
+#include <memory>
+#include <numeric>
+#include <set>
 #include <stdexcept>
 #include <string>
 #include <sys/stat.h>
@@ -23,13 +27,9 @@ namespace fs = std::filesystem;
 namespace fs = std::experimental::filesystem;
 #endif
 
-#ifdef WEB_BUILD
-#include <emscripten.h>
-#endif
-
 #include <nlohmann/json.hpp>
 
-#include "itkCastImageFilter.h"
+#include "itkBinShrinkImageFilter.h"
 #include "itkCommonEnums.h"
 #include "itkGDCMImageIO.h"
 #include "itkGDCMSeriesFileNames.h"
@@ -37,20 +37,30 @@ namespace fs = std::experimental::filesystem;
 #include "itkImageFileReader.h"
 #include "itkImageFileWriter.h"
 #include "itkImageIOBase.h"
+#include "itkImageIOFactory.h"
 #include "itkImageSeriesReader.h"
-#include "itkRescaleIntensityImageFilter.h"
+#include "itkMetaDataObject.h"
 #include "itkVectorImage.h"
 
 #include "gdcmImageHelper.h"
 #include "gdcmReader.h"
 
+#include "binaryResult.hpp"
 #include "charset.hpp"
+#include "dicom.hpp"
+#include "headerIndex.hpp"
+#include "pixelType.hpp"
+#include "rawVolume.hpp"
 #include "readTRE.hpp"
+#include "sliceCache.hpp"
+#include "tagReader.hpp"
+#include "thumbnail.hpp"
+#include "trace.hpp"
+#include "treParser.hpp"
+#include "threadPool.hpp"
+#include "volumeIndex.hpp"
 
 using json = nlohmann::json;
-using ImageType = itk::Image<float, 3>;
-using ReaderType = itk::ImageFileReader<ImageType>;
-using SeriesReaderType = itk::ImageSeriesReader<ImageType>;
 using FileNamesContainer = std::vector<std::string>;
 using DictionaryType = itk::MetaDataDictionary;
 using DicomIO = itk::GDCMImageIO;
@@ -62,15 +72,50 @@ using VolumeMapType = std::unordered_map<std::string, std::vector<std::string>>;
 using VolumeIDList = std::vector<std::string>;
 
 static int rc = 0;
-static const double EPSILON = 10e-5;
 static VolumeMapType VolumeMap;
-
+// volumeID -> index, mirrors the index file in each volume dir
+static std::unordered_map<std::string, VolumeIndex> VolumeIndexMap;
+// path -> volumeID, for every file in a loaded volume, and for files
+// imported in place that were skipped as duplicates of a slice in it
+static std::unordered_map<std::string, std::string> FileTable;
+// series and orientation group -> volume IDs SeparateOnGeometry split it
+// into, for groups import has touched
+static std::unordered_map<std::string, std::set<std::string>> VolumeGroups;
+// Import files where they are instead of moving them into volume dirs. Set
+// with --in-place.
+static bool ImportInPlace = false;
+// Slices per slab when streaming buildVolume output. 0 means the whole
+// volume at once. Set with --slab-size N.
+static size_t SlabSize = 0;
+// Budget for buildVolume pixel buffers, in MB. When set, it caps the slab
+// size. Set with --memory-limit MB.
+static unsigned long MemoryLimitMB = 0;
+// Result file format of import, readTags, readTagsBatch and readTRE. Set
+// with --format json|binary.
+enum class ResultFormat { JSON, Binary };
+static ResultFormat OutputFormat = ResultFormat::JSON;
+// Write buildVolume, buildVolumePreview and getSliceImage images as raw
+// volume files (see rawVolume.hpp) instead of by extension. Set with --raw.
+static bool RawOutput = false;
+// Thumbnails already sent, per volume, slice and size
+static ThumbnailCache Thumbnails;
+// Parsed headers and decoded pixels of slices, shared by readTags,
+// readTagsBatch, getSliceImage and buildVolume. Kept across invocations;
+// set the budget with --cache-size MB.
 #ifdef WEB_BUILD
-extern "C" const char *EMSCRIPTEN_KEEPALIVE unpack_error_what(intptr_t ptr) {
-  auto error = reinterpret_cast<std::runtime_error *>(ptr);
-  return error->what();
-}
+static SliceCache Slices(64ul << 20);
+#else
+static SliceCache Slices(256ul << 20);
 #endif
+// Per-action tracing. Set with --trace summary, or --trace FILE for a
+// Chrome trace-event file.
+static TraceMode TraceOutput = TraceMode::Off;
+static std::string TraceFile;
+// Error of the running action, if any. Makes runAction return 1 and is
+// sent back in the server response.
+static std::string ActionError;
+// Threads used for header scanning and slice decoding. Set with --threads N.
+static unsigned NumThreads = defaultThreadCount();
 
 void list_dir(const char *path) {
   struct dirent *entry;
@@ -90,25 +135,6 @@ bool dirExists(std::string path) {
   return 0 == stat(path.c_str(), &buf);
 }
 
-void replaceChars(std::string &str, char search, char replaceChar) {
-  int pos;
-  std::string replace(1, replaceChar);
-  while ((pos = str.find(search)) != std::string::npos) {
-    str.replace(pos, 1, replace);
-  }
-}
-
-std::string
-unpackMetaAsString(const itk::MetaDataObjectBase::Pointer &metaValue) {
-  using MetaDataStringType = itk::MetaDataObject<std::string>;
-  MetaDataStringType::Pointer value =
-      dynamic_cast<MetaDataStringType *>(metaValue.GetPointer());
-  if (value != nullptr) {
-    return value->GetMetaDataObjectValue();
-  }
-  return {};
-}
-
 // convenience method for making world-writable dirs
 void makedir(const std::string &dirName) {
   if (-1 == mkdir(dirName.c_str(), 0777)) {
@@ -127,211 +153,453 @@ void movefile(const std::string &src, const std::string &dst) {
   }
 }
 
-// doesn't actually do any length checks, or overflow checks, or anything
-// really.
-template <int N>
-double dotProduct(const std::vector<double> &vec1,
-                  const std::vector<double> &vec2) {
-  double result = 0;
-  for (int i = 0; i < N; i++) {
-    result += vec1.at(i) * vec2.at(i);
+// convenience method for deleting files that are no longer needed. A file
+// left behind only takes up space, so failures are logged, not thrown.
+void removefile(const std::string &filename) {
+  if (0 != std::remove(filename.c_str())) {
+    std::cerr << "Failed to remove file: " << filename << ": "
+              << std::strerror(errno) << std::endl;
   }
-  return result;
 }
 
-std::vector<double> ReadImageOrientationValue(const std::string &filename) {
-  gdcm::Reader reader;
-  reader.SetFileName(filename.c_str());
-  if (!reader.Read()) {
-    throw std::runtime_error("gdcm: failed to read file");
+// Makes the index the current slice list of the volume in memory.
+void setVolumeIndex(const std::string &volumeID, const VolumeIndex &index) {
+  VolumeIndexMap[volumeID] = index;
+  // slice numbers may now point at different files
+  Thumbnails.erase(volumeID);
+  Slices.erase(volumeID);
+  auto &fileNames = VolumeMap[volumeID];
+  fileNames.clear();
+  for (const auto &slice : index.slices) {
+    fileNames.push_back(slice.filename);
+    FileTable[slice.filename] = volumeID;
   }
-  const gdcm::File &file = reader.GetFile();
-  // This helper method asserts that the vector has length 6.
-  return gdcm::ImageHelper::GetDirectionCosinesValue(file);
 }
 
-bool areCosinesAlmostEqual(std::vector<double> cosines1,
-                           std::vector<double> cosines2,
-                           double epsilon = EPSILON) {
-  for (int i = 0; i <= 1; i++) {
-    std::vector<double> vec1{cosines1.at(i), cosines1.at(i + 1),
-                             cosines1.at(i + 2)};
-    std::vector<double> vec2{cosines2.at(i), cosines2.at(i + 1),
-                             cosines2.at(i + 2)};
-    double dot = dotProduct<3>(vec1, vec2);
-    if (dot < (1 - EPSILON)) {
-      return false;
+// Drops the FileTable entries of a volume, including skipped duplicates.
+void forgetFiles(const std::string &volumeID) {
+  for (auto it = FileTable.begin(); it != FileTable.end();) {
+    it = it->second == volumeID ? FileTable.erase(it) : std::next(it);
+  }
+}
+
+// Makes the index the current slice list of the volume, in memory and on
+// disk.
+void saveVolumeIndex(const std::string &volumeID, const VolumeIndex &index) {
+  TraceScope trace("writeVolumeIndex");
+  writeVolumeIndex(volumeID, index);
+  setVolumeIndex(volumeID, index);
+}
+
+// Rebuilds a volume's index by scanning every file in its dir.
+VolumeIndex scanVolumeDir(const std::string &volumeID) {
+  FileNamesContainer fileNames;
+  {
+    TraceScope trace("scanVolumeDir");
+    for (const auto &entry : fs::directory_iterator(volumeID)) {
+      if (fs::is_regular_file(entry.status())) {
+        fileNames.push_back(entry.path().string());
+      }
     }
   }
+
+  HeaderMapType seriesMap =
+      SeparateOnSeries(scanHeaders(fileNames, NumThreads));
+
+  // Volumes imported in place have no files in their dir, only an index.
+  if (seriesMap.empty()) {
+    throw std::runtime_error("No DICOM files or index for volume " + volumeID);
+  }
+  if (seriesMap.size() != 1) {
+    throw std::runtime_error("why are there more than 1 series/volume in this dir");
+  }
+
+  HeaderList &headers = seriesMap.begin()->second;
+  sortSlices(headers);
+  return makeVolumeIndex(headers);
+}
+
+/**
+ * Gets a volume's index from memory, then from its index file, and only
+ * then by rescanning its dir. Returns false if the volume does not exist.
+ */
+bool loadVolumeIndex(const std::string &volumeID, VolumeIndex &index) {
+  auto found = VolumeIndexMap.find(volumeID);
+  if (found != VolumeIndexMap.end()) {
+    index = found->second;
+    return true;
+  }
+  if (!dirExists(volumeID)) {
+    return false;
+  }
+  if (readVolumeIndex(volumeID, index)) {
+    setVolumeIndex(volumeID, index);
+  } else {
+    index = scanVolumeDir(volumeID);
+    saveVolumeIndex(volumeID, index);
+  }
   return true;
 }
 
-VolumeMapType SeparateOnImageOrientation(const VolumeMapType &volumeMap) {
-  VolumeMapType newVolumeMap;
-  // Vector< Pair< cosines, volumeID >>
-  std::vector<std::pair<std::vector<double>, std::string>> cosinesToID;
-
-  // append unique ID part to the volume ID, based on cosines
-  // The format replaces non-alphanumeric chars to be semi-consistent with DICOM UID spec,
-  //   and to make debugging easier when looking at the full volume IDs.
-  // Format: COSINE || "S" || COSINE || "S" || ...
-  //   COSINE: A decimal number -DD.DDDD gets reformatted into NDDSDDDD
-  auto encodeCosinesAsIDPart = [](const std::vector<double> &cosines) {
-    std::string concatenated;
-    for (auto it = cosines.begin(); it != cosines.end(); ++it) {
-      concatenated += std::to_string(*it);
-      if (it != cosines.end() - 1) {
-        concatenated += 'S';
+// Makes sure VolumeMap has the volume's slice list.
+bool loadVolume(const std::string &volumeID) {
+  if (VolumeMap.find(volumeID) != VolumeMap.end()) {
+    return true;
+  }
+  VolumeIndex index;
+  return loadVolumeIndex(volumeID, index);
+}
+
+// Whether volumeID is groupID, or groupID split by SeparateOnGeometry.
+bool isInGroup(const std::string &volumeID, const std::string &groupID) {
+  if (volumeID.compare(0, groupID.size(), groupID) != 0) {
+    return false;
+  }
+  if (volumeID.size() == groupID.size()) {
+    return true;
+  }
+  // geometry suffixes are .E, .T, .D and .S; other parts of an ID start
+  // with a digit, or N for negative cosines
+  return volumeID.size() > groupID.size() + 1 &&
+         volumeID[groupID.size()] == '.' &&
+         std::string("ETDS").find(volumeID[groupID.size() + 1]) !=
+             std::string::npos;
+}
+
+// Volumes split from a group. The first time a group is seen, they are
+// found among the volume dirs from earlier runs.
+std::set<std::string> &groupVolumes(const std::string &groupID) {
+  auto found = VolumeGroups.find(groupID);
+  if (found != VolumeGroups.end()) {
+    return found->second;
+  }
+
+  std::set<std::string> &volumeIDs = VolumeGroups[groupID];
+  for (const auto &entry : fs::directory_iterator(".")) {
+    const std::string name = entry.path().filename().string();
+    if (fs::is_directory(entry.status()) && isInGroup(name, groupID)) {
+      volumeIDs.insert(name);
+    }
+  }
+  return volumeIDs;
+}
+
+/**
+ * Merges newly scanned headers of one series and orientation group into
+ * the volumes already split from it, and regroups them. Old slices come
+ * from the volume indices, so no file is parsed twice.
+ *
+ * New files whose content (see contentKey) is already in the group, or
+ * earlier in the same import, are dropped: deleted when they were moved
+ * in, ignored when imported in place. Ignored files go into FileTable
+ * under the volume of the slice they duplicate, so later imports of the
+ * same paths skip them without parsing.
+ *
+ * Only volumes whose slices changed are saved and added to dirty. Volumes
+ * that no longer exist, e.g. because a new time point split them, are
+ * deleted and added to removed.
+ */
+void mergeIntoGroup(const std::string &groupID, HeaderList &newHeaders,
+                    VolumeIDList &dirty, VolumeIDList &removed) {
+  std::set<std::string> &oldVolumeIDs = groupVolumes(groupID);
+
+  std::vector<std::pair<std::string, VolumeIndex>> oldIndices;
+  // contentKey -> the file with that content
+  std::unordered_map<std::string, std::string> contents;
+  for (const auto &volumeID : oldVolumeIDs) {
+    VolumeIndex index;
+    try {
+      if (!loadVolumeIndex(volumeID, index)) {
+        continue;
       }
+    } catch (const std::runtime_error &e) {
+      // nothing left to regroup; the volume is removed below
+      std::cerr << "import: " << e.what() << std::endl;
+      continue;
+    }
+    for (const auto &slice : index.slices) {
+      contents.emplace(contentKey(slice), slice.filename);
     }
+    oldIndices.emplace_back(volumeID, std::move(index));
+  }
 
-    replaceChars(concatenated, '-', 'N');
-    replaceChars(concatenated, '.', 'D');
+  HeaderList added;
+  // in-place duplicate -> the file it duplicates
+  std::vector<std::pair<std::string, std::string>> duplicates;
+  for (auto &header : newHeaders) {
+    auto [original, isNew] =
+        contents.emplace(contentKey(header), header.filename);
+    if (isNew) {
+      added.push_back(std::move(header));
+    } else if (!ImportInPlace) {
+      removefile(header.filename);
+    } else {
+      duplicates.emplace_back(header.filename, original->second);
+    }
+  }
+  if (added.size() < newHeaders.size()) {
+    std::cerr << "import: skipped " << newHeaders.size() - added.size()
+              << " duplicate files in " << groupID << std::endl;
+  }
 
-    return concatenated;
+  // Moved files are named after their source file, so a new file replaces
+  // an old one of the same name.
+  auto sliceName = [](const std::string &filename) {
+    return ImportInPlace ? filename : fs::path(filename).filename().string();
   };
+  std::unordered_set<std::string> newNames;
+  for (const auto &header : added) {
+    newNames.insert(sliceName(header.filename));
+  }
+
+  HeaderList merged;
+  // filename -> the volume it was in
+  std::unordered_map<std::string, std::string> oldVolumeOf;
+  std::unordered_map<std::string, size_t> oldSizes;
+  std::unordered_map<std::string,
+                     std::unordered_map<std::string, std::string>>
+      oldTags;
+  for (auto &[volumeID, index] : oldIndices) {
+    oldTags[volumeID] = std::move(index.tags);
+    oldSizes[volumeID] = index.slices.size();
+    for (auto &slice : index.slices) {
+      if (newNames.count(sliceName(slice.filename))) {
+        if (!ImportInPlace) {
+          removefile(slice.filename);
+        }
+        continue;
+      }
+      oldVolumeOf[slice.filename] = volumeID;
+      merged.push_back(std::move(slice));
+    }
+  }
+  merged.insert(merged.end(), std::make_move_iterator(added.begin()),
+                std::make_move_iterator(added.end()));
+
+  HeaderMapType parts = SeparateOnGeometry({{groupID, std::move(merged)}});
+
+  std::set<std::string> volumeIDs;
+  for (auto &[volumeID, headers] : parts) {
+    volumeIDs.insert(volumeID);
 
+    auto oldSize = oldSizes.find(volumeID);
+    bool changed =
+        oldSize == oldSizes.end() || oldSize->second != headers.size();
+    for (auto it = headers.begin(); !changed && it != headers.end(); ++it) {
+      auto found = oldVolumeOf.find(it->filename);
+      changed = found == oldVolumeOf.end() || found->second != volumeID;
+    }
+    if (!changed) {
+      continue;
+    }
 
-  for (const auto &[volumeID, names] : volumeMap) {
-    for (const auto &filename : names) {
-      std::vector<double> curCosines = ReadImageOrientationValue(filename);
+    {
+      TraceScope trace("sortSlices");
+      sortSlices(headers);
+    }
+    // Slices from older imports no longer carry the key tags, so a volume
+    // that starts with one takes the tags of the volume that held it.
+    // Looked up now, as moving the files below renames them.
+    auto tagSource = oldVolumeOf.find(headers.front().filename);
 
-      bool inserted = false;
-      for (const auto &entry : cosinesToID) {
-        if (areCosinesAlmostEqual(curCosines, entry.first)) {
-          newVolumeMap[entry.second].push_back(filename);
-          inserted = true;
-          break;
+    // The volume dir holds the index, and also the files unless they are
+    // imported in place.
+    makedir(volumeID);
+    if (!ImportInPlace) {
+      TraceScope trace("moveFiles");
+      // assume there will be no filename conflicts within a volume
+      for (auto &header : headers) {
+        auto dst =
+            volumeID + "/" + fs::path(header.filename).filename().string();
+        if (dst != header.filename) {
+          movefile(header.filename, dst);
+          header.filename = dst;
         }
       }
+    }
 
-      if (!inserted) {
-        const auto encodedIDPart = encodeCosinesAsIDPart(curCosines);
-        auto newID = volumeID + '.' + encodedIDPart;
-        newVolumeMap[newID].push_back(filename);
-        cosinesToID.push_back(std::make_pair(curCosines, newID));
-      }
+    VolumeIndex index = makeVolumeIndex(headers);
+    if (tagSource != oldVolumeOf.end()) {
+      index.tags = oldTags.at(tagSource->second);
     }
+    saveVolumeIndex(volumeID, index);
+    dirty.push_back(volumeID);
   }
 
-  return newVolumeMap;
+  for (const auto &volumeID : oldVolumeIDs) {
+    if (!volumeIDs.count(volumeID)) {
+      // its files have all moved to other volumes
+      forgetFiles(volumeID);
+      VolumeMap.erase(volumeID);
+      VolumeIndexMap.erase(volumeID);
+      Thumbnails.erase(volumeID);
+      Slices.erase(volumeID);
+      fs::remove_all(volumeID);
+      removed.push_back(volumeID);
+    }
+  }
+  oldVolumeIDs = std::move(volumeIDs);
+
+  for (const auto &[duplicate, original] : duplicates) {
+    auto owner = FileTable.find(original);
+    if (owner != FileTable.end()) {
+      const std::string volumeID = owner->second;
+      FileTable[duplicate] = volumeID;
+    }
+  }
 }
 
+/**
+ * Imports a chunk of files. Only these files are parsed; they are merged
+ * into the volumes of earlier imports by series, orientation and the
+ * geometry kept in the volume indices.
+ *
+ * Returns {"volumeIDs": [...], "removedVolumeIDs": [...]}: the volumes
+ * whose slices changed, which need buildVolumeList again, and the volumes
+ * that were regrouped away.
+ */
 const json import(FileNamesContainer &files) {
-  // make tmp dir
   std::string tmpdir("tmp");
-  makedir(tmpdir);
-
-  // move all files to tmp
-  for (auto file : files) {
-    auto dst = tmpdir + "/" + file;
-    movefile(file, dst);
-  }
-
-  // parse out series
-  typedef itk::GDCMSeriesFileNames SeriesFileNames;
-  SeriesFileNames::Pointer seriesFileNames = SeriesFileNames::New();
-  // files are all default dumped to cwd
-  seriesFileNames->SetDirectory(tmpdir);
-  seriesFileNames->SetUseSeriesDetails(true);
-  seriesFileNames->SetGlobalWarningDisplay(false);
-  seriesFileNames->AddSeriesRestriction("0008|0021");
-  seriesFileNames->SetRecursive(false);
-  // Does this affect series organization?
-  seriesFileNames->SetLoadPrivateTags(false);
-
-  // Obtain the initial separation of imported files into distinct volumes.
-  auto &gdcmSeriesUIDs = seriesFileNames->GetSeriesUIDs();
-
-  // The initial series UIDs are used as the basis for our volume IDs.
-  VolumeMapType curVolumeMap;
-  for (auto seriesUID : gdcmSeriesUIDs) {
-    curVolumeMap[seriesUID] =
-        seriesFileNames->GetFileNames(seriesUID.c_str());
-  }
-
-  // further restrict on orientation
-  curVolumeMap = SeparateOnImageOrientation(curVolumeMap);
-
-  VolumeIDList allVolumeIDs;
-  for (const auto &entry : curVolumeMap) {
-    const std::string &volumeID = entry.first;
-    const FileNamesContainer &fileNames = entry.second;
-
-    // move files to volume dir
-    // assume there will be no filename conflicts within a volume
-    makedir(volumeID);
-    for (auto filename : fileNames) {
-      auto dst = volumeID + "/" + filename.substr(tmpdir.size() + 1);
-      movefile(filename, dst);
+
+  FileNamesContainer scanFiles;
+  if (ImportInPlace) {
+    // Files stay where they are, so a path we have seen before is the same
+    // file and does not need to be parsed again.
+    for (const auto &file : files) {
+      if (FileTable.find(file) == FileTable.end()) {
+        scanFiles.push_back(file);
+      }
     }
+  } else {
+    TraceScope trace("moveFiles");
+    // make tmp dir
+    makedir(tmpdir);
+
+    // move all files to tmp
+    for (auto file : files) {
+      auto dst = tmpdir + "/" + file;
+      movefile(file, dst);
+      scanFiles.push_back(dst);
+    }
+  }
 
-    allVolumeIDs.push_back(volumeID);
+  // Read each header once. Series separation, orientation separation and
+  // slice ordering all work off of this index.
+  HeaderList headers = scanHeaders(scanFiles, NumThreads);
+
+  // The initial series IDs are used as the basis for our volume IDs,
+  // further restricted on orientation. Geometry splits (time points,
+  // echoes, repeated positions, uneven spacing) need the whole group, so
+  // they happen after merging with earlier imports.
+  HeaderMapType groups = SeparateOnImageOrientation(SeparateOnSeries(headers));
+
+  VolumeIDList dirty, removed;
+  for (auto &[groupID, groupHeaders] : groups) {
+    mergeIntoGroup(groupID, groupHeaders, dirty, removed);
   }
-  return json(allVolumeIDs);
+
+  return {{"volumeIDs", dirty}, {"removedVolumeIDs", removed}};
 }
 
 /**
  * buildVolumeList exists to support multiple import() calls prior to building a
  * volume.
  *
- * This solves the issues
+ * This only rescans the volume dir if the volume has no usable index.
  */
 int buildVolumeList(const std::string &volumeID) {
   if (dirExists(volumeID)) {
-    typedef itk::GDCMSeriesFileNames SeriesFileNames;
-    SeriesFileNames::Pointer seriesFileNames = SeriesFileNames::New();
-    seriesFileNames->SetDirectory(volumeID);
-    seriesFileNames->SetUseSeriesDetails(true);
-    seriesFileNames->SetGlobalWarningDisplay(false);
-    seriesFileNames->AddSeriesRestriction("0008|0021");
-    seriesFileNames->SetRecursive(false);
-    seriesFileNames->SetLoadPrivateTags(false);
+    VolumeIndex index;
+    loadVolumeIndex(volumeID, index);
+    return index.slices.size();
+  }
+  std::cerr << "Could not build volume " << volumeID << std::endl;
+  return 0;
+}
+
+// Returns the converter for a SpecificCharacterSet value. Converters keep
+// their iconv descriptors open, so they are kept across calls.
+CharStringToUTF8Converter &converterFor(const std::string &charsets) {
+  static std::unordered_map<std::string, CharStringToUTF8Converter> converters;
+  auto found = converters.find(charsets);
+  if (found == converters.end()) {
+    found = converters.try_emplace(charsets, charsets).first;
+  }
+  return found->second;
+}
 
-    VolumeIDList uids = seriesFileNames->GetSeriesUIDs();
+// Requested tags without the '@' conversion prefix, plus the character set
+// needed to convert them.
+TagList tagsToRead(const TagList &tags) {
+  TagList names{"0008|0005"};
+  for (const auto &tag : tags) {
+    names.push_back(tag[0] == '@' ? tag.substr(1) : tag);
+  }
+  return names;
+}
 
-    if (uids.size() != 1) {
-      throw std::runtime_error("why are there more than 1 series/volume in this dir");
+// Tags of one slice. Only tags not cached yet are read from the file.
+TagValueMap readSliceTags(const std::string &volumeID, unsigned long slice,
+                          const TagList &names) {
+  CachedSlice &cached = Slices.get(volumeID, slice);
+  TagList missing;
+  for (const auto &name : names) {
+    if (cached.tags.find(name) == cached.tags.end()) {
+      missing.push_back(name);
     }
+  }
 
-    VolumeMap[volumeID] = seriesFileNames->GetFileNames(uids[0].c_str());
-    auto &map = VolumeMap[volumeID];
-    for (auto &filename : map) {
-      // trim off dir + "/"
-      filename = filename.substr(volumeID.size() + 1);
+  if (missing.empty()) {
+    Slices.stats().tagHits++;
+  } else {
+    Slices.stats().tagMisses++;
+    const std::string &filename = VolumeMap.at(volumeID).at(slice);
+    TagValueMap values;
+    if (!TagReader(missing).read(filename, values)) {
+      throw std::runtime_error("Failed to read tags from " + filename);
     }
-    return map.size();
+    cached.tags.insert(values.begin(), values.end());
+    Slices.update(volumeID, slice);
   }
-  std::cerr << "Could not build volume " << volumeID << std::endl;
-  return 0;
+
+  TagValueMap values;
+  for (const auto &name : names) {
+    values[name] = cached.tags[name];
+  }
+  return values;
 }
 
 const json readTags(const std::string &volumeID, unsigned long slice,
                     const TagList &tags) {
   json tagJson;
 
-  if (VolumeMap.find(volumeID) != VolumeMap.end()) {
+  if (loadVolume(volumeID)) {
     FileNamesContainer fileList = VolumeMap.at(volumeID);
 
     if (slice >= 0 && slice < fileList.size()) {
-      auto filename = fileList.at(slice);
-
-      typename DicomIO::Pointer dicomIO = DicomIO::New();
-      dicomIO->LoadPrivateTagsOff();
-      typename ReaderType::Pointer reader = ReaderType::New();
-      reader->UseStreamingOn();
-      reader->SetImageIO(dicomIO);
+      const auto &indexTags = VolumeIndexMap.at(volumeID).tags;
+
+      // The index has the volume-level key tags, so the file only needs to
+      // be opened for anything else.
+      bool inIndex = slice == 0;
+      for (auto it = tags.begin(); inIndex && it != tags.end(); ++it) {
+        auto tag = (*it)[0] == '@' ? it->substr(1) : *it;
+        inIndex = indexTags.find(tag) != indexTags.end();
+      }
 
-      auto fullFilename = volumeID + "/" + filename;
-      dicomIO->SetFileName(fullFilename);
-      reader->SetFileName(fullFilename);
-      reader->UpdateOutputInformation();
+      TagValueMap fileTags;
+      if (!inIndex) {
+        fileTags = readSliceTags(volumeID, slice, tagsToRead(tags));
+      }
 
-      DictionaryType tagsDict = reader->GetMetaDataDictionary();
+      auto lookup = [&](const std::string &tag) {
+        const TagValueMap &values = inIndex ? indexTags : fileTags;
+        auto found = values.find(tag);
+        return found != values.end() ? found->second : std::string();
+      };
 
-      std::string specificCharacterSet =
-          unpackMetaAsString(tagsDict["0008|0005"]);
-      CharStringToUTF8Converter conv(specificCharacterSet);
+      TraceScope trace("charsetConversion");
+      CharStringToUTF8Converter &conv = converterFor(lookup("0008|0005"));
 
       for (auto it = tags.begin(); it != tags.end(); ++it) {
         auto tag = *it;
@@ -341,7 +609,7 @@ const json readTags(const std::string &volumeID, unsigned long slice,
           tag = tag.substr(1);
         }
 
-        auto value = unpackMetaAsString(tagsDict[tag]);
+        auto value = lookup(tag);
         if (doConvert) {
           value = conv.convertCharStringToUTF8(value);
         }
@@ -354,49 +622,395 @@ const json readTags(const std::string &volumeID, unsigned long slice,
   return tagJson;
 }
 
-void getSliceImage(const std::string &volumeID, unsigned long slice,
-                   const std::string &outFileName, bool asThumbnail) {
-  VolumeMapType::const_iterator found = VolumeMap.find(volumeID);
-  if (found != VolumeMap.end()) {
-    FileNamesContainer fileList = VolumeMap.at(volumeID);
-    std::string filename = volumeID + "/" + fileList.at(slice - 1);
+/**
+ * Reads tags from slices [start, end) of a volume.
+ *
+ * Returns one column per tag, e.g. {"0020|0013": ["1", "2", ...]}, with a
+ * value for every slice in the range. Tags prefixed with '@' are converted
+ * to UTF-8 as in readTags().
+ */
+const json readTagsBatch(const std::string &volumeID, unsigned long start,
+                         unsigned long end, const TagList &tags) {
+  json columns = json::object();
+
+  if (!loadVolume(volumeID)) {
+    return columns;
+  }
+
+  const FileNamesContainer &fileList = VolumeMap.at(volumeID);
+  end = std::min<unsigned long>(end, fileList.size());
+
+  std::vector<std::pair<std::string, bool>> parsedTags;
+  for (const auto &tag : tags) {
+    bool doConvert = tag[0] == '@';
+    parsedTags.emplace_back(doConvert ? tag.substr(1) : tag, doConvert);
+    columns[parsedTags.back().first] = json::array();
+  }
+
+  // Cached slices are filled in first. The rest are parsed in parallel,
+  // each into its own slot, and cached afterwards on this thread, as is
+  // conversion, since the cache and converters are shared.
+  const TagList names = tagsToRead(tags);
+  std::vector<TagValueMap> sliceTags(end > start ? end - start : 0);
+  std::vector<size_t> misses;
+  for (size_t i = 0; i < sliceTags.size(); i++) {
+    const CachedSlice &cached = Slices.get(volumeID, start + i);
+    bool hit = true;
+    for (auto it = names.begin(); hit && it != names.end(); ++it) {
+      auto found = cached.tags.find(*it);
+      hit = found != cached.tags.end();
+      if (hit) {
+        sliceTags[i][*it] = found->second;
+      }
+    }
+    if (hit) {
+      Slices.stats().tagHits++;
+    } else {
+      Slices.stats().tagMisses++;
+      misses.push_back(i);
+    }
+  }
+
+  TagReader tagReader(names);
+  sharedThreadPool(NumThreads).parallelFor(misses.size(), [&](size_t m) {
+    const size_t i = misses[m];
+    if (!tagReader.read(fileList.at(start + i), sliceTags[i])) {
+      throw std::runtime_error("Failed to read tags from " +
+                               fileList.at(start + i));
+    }
+  });
+
+  for (size_t i : misses) {
+    CachedSlice &cached = Slices.get(volumeID, start + i);
+    cached.tags.insert(sliceTags[i].begin(), sliceTags[i].end());
+    Slices.update(volumeID, start + i);
+  }
+
+  TraceScope trace("charsetConversion");
+  for (auto &values : sliceTags) {
+    CharStringToUTF8Converter &conv = converterFor(values["0008|0005"]);
+
+    for (const auto &[tag, doConvert] : parsedTags) {
+      auto value = values[tag];
+      if (doConvert) {
+        value = conv.convertCharStringToUTF8(value);
+      }
+      columns[tag].push_back(value);
+    }
+  }
+
+  return columns;
+}
+
+// Pixel component type of a DICOM file after rescale slope/intercept.
+itk::IOComponentEnum readComponentType(const std::string &filename) {
+  DicomIO::Pointer dicomIO = DicomIO::New();
+  dicomIO->LoadPrivateTagsOff();
+  dicomIO->SetFileName(filename);
+  dicomIO->ReadImageInformation();
+  return dicomIO->GetComponentType();
+}
+
+// Pixel component type of a slice, without opening it if it is cached.
+itk::IOComponentEnum sliceComponentType(const std::string &volumeID,
+                                        unsigned long slice) {
+  const CachedSlice *cached = Slices.peek(volumeID, slice);
+  if (cached && cached->image) {
+    return cached->componentType;
+  }
+  if (cached &&
+      cached->fileComponentType != itk::IOComponentEnum::UNKNOWNCOMPONENTTYPE) {
+    return cached->fileComponentType;
+  }
+  const auto componentType =
+      readComponentType(VolumeMap.at(volumeID).at(slice));
+  Slices.get(volumeID, slice).fileComponentType = componentType;
+  Slices.update(volumeID, slice);
+  return componentType;
+}
+
+// Decodes and rescales one slice file, converting to TPixel if needed.
+template <typename TPixel>
+typename itk::Image<TPixel, 3>::Pointer
+decodeSlice(const std::string &filename) {
+  using SliceImageType = itk::Image<TPixel, 3>;
+
+  DicomIO::Pointer dicomIO = DicomIO::New();
+  dicomIO->LoadPrivateTagsOff();
+  auto sliceReader = itk::ImageFileReader<SliceImageType>::New();
+  sliceReader->SetImageIO(dicomIO);
+  sliceReader->SetFileName(filename);
+  {
+    TraceScope trace("decodeSlice");
+    traceFileRead(filename);
+    sliceReader->Update();
+  }
+  typename SliceImageType::Pointer image = sliceReader->GetOutput();
+  image->DisconnectPipeline();
+  return image;
+}
+
+// Decodes one slice file straight into `out`, which holds numPixels. This
+// skips the intermediate image of decodeSlice, so it only works when GDCM
+// decodes to TPixel itself and the file has exactly numPixels grayscale
+// pixels. Returns false, without reading pixel data, otherwise.
+template <typename TPixel>
+bool decodeSliceInto(const std::string &filename, TPixel *out,
+                     size_t numPixels) {
+  DicomIO::Pointer dicomIO = DicomIO::New();
+  dicomIO->LoadPrivateTagsOff();
+  dicomIO->SetFileName(filename);
+  dicomIO->ReadImageInformation();
+
+  size_t filePixels = 1;
+  for (unsigned d = 0; d < dicomIO->GetNumberOfDimensions(); d++) {
+    filePixels *= dicomIO->GetDimensions(d);
+  }
+  if (dicomIO->GetComponentType() != componentTypeOf<TPixel>() ||
+      dicomIO->GetNumberOfComponents() != 1 || filePixels != numPixels) {
+    return false;
+  }
+
+  TraceScope trace("decodeSlice");
+  traceFileRead(filename);
+  dicomIO->Read(out);
+  return true;
+}
+
+// Decodes a slice with a GDCMImageIO that has already read the header, into
+// an image with the geometry ImageFileReader would give it. Returns null,
+// without reading pixel data, if GDCM does not decode to TPixel itself or
+// the file is not grayscale.
+template <typename TPixel>
+typename itk::Image<TPixel, 3>::Pointer readSliceFromIO(DicomIO *dicomIO) {
+  using SliceImageType = itk::Image<TPixel, 3>;
+  if (dicomIO->GetComponentType() != componentTypeOf<TPixel>() ||
+      dicomIO->GetNumberOfComponents() != 1) {
+    return nullptr;
+  }
+
+  typename SliceImageType::SizeType size;
+  typename SliceImageType::SpacingType spacing;
+  typename SliceImageType::PointType origin;
+  typename SliceImageType::DirectionType direction;
+  direction.SetIdentity();
+  for (unsigned i = 0; i < 3; i++) {
+    size[i] = 1;
+    spacing[i] = 1;
+    origin[i] = 0;
+    if (i < dicomIO->GetNumberOfDimensions()) {
+      size[i] = dicomIO->GetDimensions(i);
+      spacing[i] = dicomIO->GetSpacing(i);
+      origin[i] = dicomIO->GetOrigin(i);
+      const std::vector<double> axis = dicomIO->GetDirection(i);
+      for (unsigned j = 0; j < 3 && j < axis.size(); j++) {
+        direction[j][i] = axis[j];
+      }
+    }
+  }
+
+  auto image = SliceImageType::New();
+  image->SetRegions(size);
+  image->SetSpacing(spacing);
+  image->SetOrigin(origin);
+  image->SetDirection(direction);
+  image->Allocate();
+  dicomIO->Read(image->GetBufferPointer());
+  return image;
+}
+
+// Adds a decoded slice to the cache, keeping any tags already there.
+template <typename TPixel>
+void cacheSlice(const std::string &volumeID, unsigned long slice,
+                itk::Image<TPixel, 3> *image) {
+  CachedSlice &cached = Slices.get(volumeID, slice);
+  cached.image = image;
+  cached.componentType = componentTypeOf<TPixel>();
+  cached.pixelBytes =
+      image->GetLargestPossibleRegion().GetNumberOfPixels() * sizeof(TPixel);
+  Slices.update(volumeID, slice);
+}
+
+// Decoded, rescaled pixels of one slice, from the cache if it has them in
+// this pixel type. With cacheResult false a decoded slice is not added, so
+// one pass over a large series does not push out everything else.
+template <typename TPixel>
+typename itk::Image<TPixel, 3>::Pointer
+decodedSlice(const std::string &volumeID, unsigned long slice,
+             bool cacheResult) {
+  using SliceImageType = itk::Image<TPixel, 3>;
+
+  if (const CachedSlice *cached = Slices.peek(volumeID, slice)) {
+    auto *image = dynamic_cast<SliceImageType *>(cached->image.GetPointer());
+    if (image) {
+      Slices.stats().pixelHits++;
+      Slices.get(volumeID, slice);
+      return image;
+    }
+  }
+  Slices.stats().pixelMisses++;
+
+  auto image = decodeSlice<TPixel>(VolumeMap.at(volumeID).at(slice));
+
+  if (cacheResult) {
+    cacheSlice<TPixel>(volumeID, slice, image);
+  }
+  return image;
+}
 
-    typename DicomIO::Pointer dicomIO = DicomIO::New();
+// Geometry and pixel type of an image, for a raw volume file.
+template <typename TPixel>
+RawVolumeInfo rawVolumeInfo(const itk::Image<TPixel, 3> *image) {
+  RawVolumeInfo info;
+  info.componentType = componentTypeOf<TPixel>();
+  const auto size = image->GetLargestPossibleRegion().GetSize();
+  for (unsigned i = 0; i < 3; i++) {
+    info.size[i] = size[i];
+    info.spacing[i] = image->GetSpacing()[i];
+    info.origin[i] = image->GetOrigin()[i];
+    for (unsigned j = 0; j < 3; j++) {
+      info.direction[3 * i + j] = image->GetDirection()[i][j];
+    }
+  }
+  return info;
+}
+
+// Writes an image in the format its extension implies, or as a raw volume
+// file with --raw.
+template <typename TPixel>
+void writeImage(const itk::Image<TPixel, 3> *image,
+                const std::string &outFileName) {
+  TraceScope trace("writeImage");
+  if (RawOutput) {
+    RawVolumeFile file(outFileName, rawVolumeInfo(image));
+    file.writePixels(0, image->GetBufferPointer(), file.pixelsLength());
+    file.close();
+    return;
+  }
+
+  auto writer = itk::ImageFileWriter<itk::Image<TPixel, 3>>::New();
+  writer->SetInput(image);
+  writer->SetFileName(outFileName);
+  writer->Update();
+}
+
+// Tags a thumbnail's window is made from
+static const TagList ThumbnailWindowTags{"0028|1050", "0028|1051",
+                                         "0028|0004"};
+
+// Makes the thumbnail of a slice from its cached window tags and pixels.
+// Whatever is not cached comes from one GDCMImageIO: its header read gives
+// the window tags and component type, then it decodes the pixels. All of it
+// is cached.
+Thumbnail sliceThumbnail(const std::string &volumeID, unsigned long index,
+                         unsigned thumbnailSize) {
+  const std::string &filename = VolumeMap.at(volumeID).at(index);
+
+  const CachedSlice *cached = Slices.peek(volumeID, index);
+  bool hasTags = cached != nullptr;
+  for (const auto &name : ThumbnailWindowTags) {
+    hasTags = hasTags && cached->tags.count(name) > 0;
+  }
+  const bool hasImage = cached && cached->image;
+  hasTags ? Slices.stats().tagHits++ : Slices.stats().tagMisses++;
+
+  DicomIO::Pointer dicomIO;
+  if (!hasTags || !hasImage) {
+    dicomIO = DicomIO::New();
     dicomIO->LoadPrivateTagsOff();
-    typename ReaderType::Pointer reader = ReaderType::New();
-    reader->SetFileName(filename);
+    dicomIO->SetFileName(filename);
+    dicomIO->ReadImageInformation();
+
+    CachedSlice &entry = Slices.get(volumeID, index);
+    entry.fileComponentType = dicomIO->GetComponentType();
+    const auto &dictionary = dicomIO->GetMetaDataDictionary();
+    for (const auto &name : ThumbnailWindowTags) {
+      std::string value;
+      itk::ExposeMetaData<std::string>(dictionary, name, value);
+      entry.tags.emplace(name, value);
+    }
+    Slices.update(volumeID, index);
+    cached = &entry;
+  }
 
-    // cast images to unsigned char for easier thumbnailing to canvas ImageData
-    // if asThumbnail is specified.
+  const ThumbnailWindow window = makeThumbnailWindow(
+      cached->tags.at("0028|1050"), cached->tags.at("0028|1051"),
+      cached->tags.at("0028|0004"));
+  const auto componentType =
+      hasImage ? cached->componentType : cached->fileComponentType;
+
+  Thumbnail thumb;
+  dispatchComponentType(componentType, [&](auto tag) {
+    using PixelType = typename decltype(tag)::type;
+    using SliceImageType = itk::Image<PixelType, 3>;
+
+    typename SliceImageType::Pointer image;
+    if (hasImage) {
+      Slices.stats().pixelHits++;
+      image = dynamic_cast<SliceImageType *>(cached->image.GetPointer());
+      Slices.get(volumeID, index);
+    } else {
+      Slices.stats().pixelMisses++;
+      {
+        TraceScope trace("decodeSlice");
+        traceFileRead(filename);
+        image = readSliceFromIO<PixelType>(dicomIO);
+      }
+      if (!image) {
+        // e.g. color, which ImageFileReader converts to luminance
+        image = decodeSlice<PixelType>(filename);
+      }
+      cacheSlice<PixelType>(volumeID, index, image);
+    }
+
+    const auto size = image->GetLargestPossibleRegion().GetSize();
+    thumb = makeThumbnail(image->GetBufferPointer(), size[0], size[1],
+                          thumbnailSize, window);
+  });
+  return thumb;
+}
+
+void getSliceImage(const std::string &volumeID, unsigned long slice,
+                   const std::string &outFileName, bool asThumbnail,
+                   unsigned thumbnailSize) {
+  if (loadVolume(volumeID)) {
+    // slice numbers are 1-based, cache entries 0-based like readTags
+    const unsigned long index = slice - 1;
+    if (index >= VolumeMap.at(volumeID).size()) {
+      throw std::runtime_error("No slice " + std::to_string(slice) +
+                               " in volume " + volumeID);
+    }
+
+    // thumbnails are windowed to unsigned char for easier drawing to canvas
+    // ImageData, and shrunk so neither side exceeds thumbnailSize.
     if (asThumbnail) {
-      using InputImageType = ImageType;
-      using OutputPixelType = unsigned char;
-      using OutputImageType = itk::Image<OutputPixelType, 3>;
-      using RescaleFilter =
-          itk::RescaleIntensityImageFilter<InputImageType, InputImageType>;
-      using CastImageFilter =
-          itk::CastImageFilter<InputImageType, OutputImageType>;
-
-      auto rescaleFilter = RescaleFilter::New();
-      rescaleFilter->SetInput(reader->GetOutput());
-      rescaleFilter->SetOutputMinimum(0);
-      rescaleFilter->SetOutputMaximum(
-          itk::NumericTraits<OutputPixelType>::max());
-
-      auto castFilter = CastImageFilter::New();
-      castFilter->SetInput(rescaleFilter->GetOutput());
-
-      using WriterType = itk::ImageFileWriter<OutputImageType>;
-      auto writer = WriterType::New();
-      writer->SetInput(castFilter->GetOutput());
-      writer->SetFileName(outFileName);
-      writer->Update();
+      const Thumbnail *thumb =
+          Thumbnails.find(volumeID, slice, thumbnailSize);
+      if (!thumb) {
+        TraceScope trace("makeThumbnail");
+        thumb = &Thumbnails.insert(volumeID, slice, thumbnailSize,
+                                   sliceThumbnail(volumeID, index,
+                                                  thumbnailSize));
+      }
+
+      using ThumbnailImageType = itk::Image<unsigned char, 3>;
+      auto image = ThumbnailImageType::New();
+      ThumbnailImageType::SizeType size;
+      size[0] = thumb->width;
+      size[1] = thumb->height;
+      size[2] = 1;
+      image->SetRegions(size);
+      image->Allocate();
+      std::copy(thumb->pixels.begin(), thumb->pixels.end(),
+                image->GetBufferPointer());
+      writeImage<unsigned char>(image, outFileName);
     } else {
-      using WriterType = itk::ImageFileWriter<ImageType>;
-      auto writer = WriterType::New();
-      writer->SetInput(reader->GetOutput());
-      writer->SetFileName(outFileName);
-      writer->Update();
+      // keep the slice in its stored pixel type
+      dispatchComponentType(sliceComponentType(volumeID, index), [&](auto tag) {
+        using PixelType = typename decltype(tag)::type;
+        writeImage<PixelType>(decodedSlice<PixelType>(volumeID, index, true),
+                              outFileName);
+      });
     }
   } else {
     throw std::runtime_error("No thumbnail for volume ID: " + volumeID);
@@ -404,44 +1018,454 @@ void getSliceImage(const std::string &volumeID, unsigned long slice,
   }
 }
 
+bool hasUniformRescale(const HeaderList &slices) {
+  for (const auto &slice : slices) {
+    if (slice.rescaleIntercept != slices.front().rescaleIntercept ||
+        slice.rescaleSlope != slices.front().rescaleSlope) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// When tracing, records each run of a series reader as a decodeSlices span
+// and counts the files it reads. The reader runs once per streamed slab.
+void traceReads(itk::ProcessObject *reader,
+                const FileNamesContainer &fileNames) {
+  if (!traceEnabled()) {
+    return;
+  }
+  for (const auto &filename : fileNames) {
+    traceFileRead(filename);
+  }
+  auto start = std::make_shared<int64_t>(0);
+  reader->AddObserver(itk::StartEvent(), [start](const itk::EventObject &) {
+    *start = traceNow();
+  });
+  reader->AddObserver(itk::EndEvent(), [start](const itk::EventObject &) {
+    traceSpan("decodeSlices", *start, traceNow());
+  });
+}
+
+// Number of Z-slabs to stream a volume in, given the slab options.
+unsigned numberOfSlabs(const itk::Size<3> &size, size_t pixelBytes) {
+  size_t slabSlices = SlabSize;
+  if (MemoryLimitMB > 0) {
+    // A slab is buffered once by the reader and once on its way out
+    size_t sliceBytes = size[0] * size[1] * pixelBytes;
+    size_t budget = static_cast<size_t>(MemoryLimitMB) * 1024 * 1024;
+    size_t budgetSlices = std::max<size_t>(1, budget / (2 * sliceBytes));
+    slabSlices = slabSlices ? std::min(slabSlices, budgetSlices) : budgetSlices;
+  }
+  if (slabSlices == 0 || slabSlices >= size[2]) {
+    return 1;
+  }
+  return (size[2] + slabSlices - 1) / slabSlices;
+}
+
+// Fills a buffer with the given slices of a volume, in order. Cached
+// slices are copied in; the rest are decoded in parallel, each straight into
+// its place where GDCM allows (see decodeSliceInto). JPEG, JPEG-LS, JPEG 2000
+// and RLE slices decompress independently, so this scales with the thread
+// count. With cacheResult the decoded slices are cached as well, at the cost
+// of one extra copy each.
+template <typename TPixel>
+void assembleSlices(const std::string &volumeID,
+                    const std::vector<size_t> &slices, size_t sliceLength,
+                    TPixel *buffer, bool cacheResult) {
+  using SliceImageType = itk::Image<TPixel, 3>;
+  const FileNamesContainer &fileNames = VolumeMap.at(volumeID);
+
+  auto copySlice = [&](size_t z, const SliceImageType *slice) {
+    if (slice->GetLargestPossibleRegion().GetNumberOfPixels() != sliceLength) {
+      throw std::runtime_error("Slice " + std::to_string(slices[z]) +
+                               " of volume " + volumeID + " differs in size");
+    }
+    std::copy_n(slice->GetBufferPointer(), sliceLength,
+                buffer + z * sliceLength);
+  };
+
+  // the cache is not thread-safe, so hits are taken here
+  std::vector<size_t> misses;
+  for (size_t z = 0; z < slices.size(); z++) {
+    const CachedSlice *cached = Slices.peek(volumeID, slices[z]);
+    auto *image =
+        cached ? dynamic_cast<SliceImageType *>(cached->image.GetPointer())
+               : nullptr;
+    if (image) {
+      Slices.stats().pixelHits++;
+      copySlice(z, image);
+    } else {
+      Slices.stats().pixelMisses++;
+      misses.push_back(z);
+    }
+  }
+
+  std::vector<typename SliceImageType::Pointer> decoded(
+      cacheResult ? misses.size() : 0);
+  sharedThreadPool(NumThreads).parallelFor(misses.size(), [&](size_t m) {
+    const size_t z = misses[m];
+    const std::string &filename = fileNames[slices[z]];
+    if (cacheResult) {
+      decoded[m] = decodeSlice<TPixel>(filename);
+      copySlice(z, decoded[m]);
+    } else if (!decodeSliceInto(filename, buffer + z * sliceLength,
+                                sliceLength)) {
+      // e.g. color, or a rescale GDCM decodes to a different type
+      copySlice(z, decodeSlice<TPixel>(filename));
+    }
+  });
+
+  for (size_t m = 0; m < decoded.size(); m++) {
+    cacheSlice<TPixel>(volumeID, slices[misses[m]], decoded[m]);
+  }
+}
+
+// Fills a volume buffer with all of its slices. Slices decoded here are not
+// cached, so one build does not push out everything else.
+template <typename TPixel>
+void assembleVolume(const std::string &volumeID, const itk::Size<3> &size,
+                    TPixel *buffer) {
+  TraceScope trace("assembleVolume");
+  std::vector<size_t> slices(size[2]);
+  std::iota(slices.begin(), slices.end(), 0);
+  assembleSlices<TPixel>(volumeID, slices, size[0] * size[1], buffer, false);
+}
+
+// Fills an unmapped raw volume file in as many slabs as numberOfSlabs asks
+// for, so only one slab is in memory at a time.
+template <typename TPixel>
+void writeRawSlabs(const std::string &volumeID, const itk::Size<3> &size,
+                   RawVolumeFile &file) {
+  TraceScope trace("assembleVolume");
+  const size_t sliceLength = size[0] * size[1];
+  const unsigned numSlabs = numberOfSlabs(size, sizeof(TPixel));
+  const size_t slabSlices = (size[2] + numSlabs - 1) / numSlabs;
+  std::vector<TPixel> slab(slabSlices * sliceLength);
+
+  for (size_t z = 0, n = 0; z < size[2]; z += slabSlices) {
+    std::vector<size_t> slices(std::min<size_t>(slabSlices, size[2] - z));
+    std::iota(slices.begin(), slices.end(), z);
+    assembleSlices<TPixel>(volumeID, slices, sliceLength, slab.data(), false);
+    file.writePixels(z * sliceLength * sizeof(TPixel), slab.data(),
+                     slices.size() * sliceLength * sizeof(TPixel));
+    if (numSlabs > 1) {
+      std::cerr << "buildVolume: slab " << ++n << "/" << numSlabs
+                << std::endl;
+    }
+  }
+}
+
+template <typename TPixel>
+void writeVolume(const std::string &volumeID,
+                 const FileNamesContainer &fileNames,
+                 const std::string &outFileName) {
+  using VolumeImageType = itk::Image<TPixel, 3>;
+
+  DicomIO::Pointer dicomIO = DicomIO::New();
+  dicomIO->LoadPrivateTagsOff();
+  auto reader = itk::ImageSeriesReader<VolumeImageType>::New();
+  reader->SetImageIO(dicomIO);
+  // this should be ordered from import
+  reader->SetFileNames(fileNames);
+  // reader->ForceOrthogonalDirectionOn();
+  // hopefully this makes things faster?
+  reader->MetaDataDictionaryArrayUpdateOff();
+  // only read the slices of the slab currently being written
+  reader->UseStreamingOn();
+  reader->UpdateOutputInformation();
+  const auto size = reader->GetOutput()->GetLargestPossibleRegion().GetSize();
+
+  // Mapped raw output needs no slabs: slices are decoded straight into the
+  // file and the kernel writes pages back as memory runs low. Unmapped, the
+  // slices are assembled a slab at a time and written through.
+  if (RawOutput) {
+    TraceScope trace("writeVolume");
+    RawVolumeFile file(outFileName, rawVolumeInfo(reader->GetOutput()));
+    if (size[2] == fileNames.size() && file.mapped()) {
+      assembleVolume<TPixel>(volumeID, size,
+                             static_cast<TPixel *>(file.pixels()));
+    } else if (size[2] == fileNames.size()) {
+      writeRawSlabs<TPixel>(volumeID, size, file);
+    } else {
+      traceReads(reader, fileNames);
+      reader->Update();
+      file.writePixels(0, reader->GetOutput()->GetBufferPointer(),
+                       file.pixelsLength());
+    }
+    file.close();
+    return;
+  }
+
+  using WriterType = itk::ImageFileWriter<VolumeImageType>;
+  auto writer = WriterType::New();
+  writer->SetInput(reader->GetOutput());
+  writer->SetFileName(outFileName);
+
+  unsigned numSlabs = numberOfSlabs(size, sizeof(TPixel));
+  bool streamed = false;
+  if (numSlabs > 1) {
+    auto outputIO = itk::ImageIOFactory::CreateImageIO(
+        outFileName.c_str(), itk::IOFileModeEnum::WriteMode);
+    if (outputIO && outputIO->CanStreamWrite()) {
+      writer->SetImageIO(outputIO);
+      // the default splitter cuts along Z
+      writer->SetNumberOfStreamDivisions(numSlabs);
+      streamed = true;
+
+      unsigned slab = 0;
+      reader->AddObserver(itk::EndEvent(), [&](const itk::EventObject &) {
+        std::cerr << "buildVolume: slab " << ++slab << "/" << numSlabs
+                  << std::endl;
+      });
+    } else {
+      std::cerr << "buildVolume: " << outFileName
+                << " cannot be written in slabs; writing whole volume"
+                << std::endl;
+    }
+  }
+
+  // Whole volumes are put together from single slices, so slices already
+  // decoded for getSliceImage are reused. The series reader only runs for
+  // slabs, or when files hold more than one slice each.
+  typename VolumeImageType::Pointer volume;
+  if (!streamed && size[2] == fileNames.size()) {
+    volume = VolumeImageType::New();
+    volume->CopyInformation(reader->GetOutput());
+    volume->SetRegions(reader->GetOutput()->GetLargestPossibleRegion());
+    volume->Allocate();
+    assembleVolume<TPixel>(volumeID, size, volume->GetBufferPointer());
+    writer->SetInput(volume);
+  } else {
+    traceReads(reader, fileNames);
+  }
+
+  TraceScope trace("writeVolume");
+  writer->Update();
+}
+
+// Build volumes in the pixel type GDCM reports for the series.
+// GDCMImageIO already widens to a type that holds the rescaled values,
+// and leaves the stored type alone when slope/intercept are identity or
+// integral, so e.g. 16-bit CT stays 16-bit. That only holds for the
+// whole series if every slice has the same rescale; otherwise use float.
+itk::IOComponentEnum volumeComponentType(const std::string &volumeID) {
+  if (hasUniformRescale(VolumeIndexMap.at(volumeID).slices)) {
+    return readComponentType(VolumeMap.at(volumeID).front());
+  }
+  return itk::IOComponentEnum::FLOAT;
+}
+
 void buildVolume(const std::string &volumeID,
                  const std::string &outFileName) {
-  VolumeMapType::const_iterator found = VolumeMap.find(volumeID);
-  if (found != VolumeMap.end()) {
-    FileNamesContainer fileList = VolumeMap.at(volumeID);
-    FileNamesContainer fileNames(fileList);
+  if (loadVolume(volumeID)) {
+    const FileNamesContainer &fileNames = VolumeMap.at(volumeID);
 
-    for (FileNamesContainer::iterator it = fileNames.begin();
-         it != fileNames.end(); ++it) {
-      *it = volumeID + "/" + *it;
+    if (fileNames.empty()) {
+      throw std::runtime_error("No slices in volume " + volumeID);
     }
 
-    DicomIO::Pointer dicomIO = DicomIO::New();
-    dicomIO->LoadPrivateTagsOff();
-    SeriesReaderType::Pointer reader = SeriesReaderType::New();
-    // this should be ordered from import
-    reader->SetFileNames(fileNames);
-    // reader->ForceOrthogonalDirectionOn();
-    // hopefully this makes things faster?
-    reader->MetaDataDictionaryArrayUpdateOff();
-    reader->UseStreamingOn();
+    dispatchComponentType(volumeComponentType(volumeID), [&](auto tag) {
+      using PixelType = typename decltype(tag)::type;
+      writeVolume<PixelType>(volumeID, fileNames, outFileName);
+    });
+  }
+}
 
-    using WriterType = itk::ImageFileWriter<ImageType>;
-    auto writer = WriterType::New();
-    writer->SetInput(reader->GetOutput());
-    writer->SetFileName(outFileName);
-    writer->Update();
+template <typename TPixel>
+void writeVolumePreview(const std::string &volumeID, unsigned factor,
+                        const std::string &outFileName) {
+  using VolumeImageType = itk::Image<TPixel, 3>;
+
+  const FileNamesContainer &fileNames = VolumeMap.at(volumeID);
+  std::vector<size_t> slices;
+  FileNamesContainer strided;
+  for (size_t i = 0; i < fileNames.size(); i += factor) {
+    slices.push_back(i);
+    strided.push_back(fileNames[i]);
   }
+
+  DicomIO::Pointer dicomIO = DicomIO::New();
+  dicomIO->LoadPrivateTagsOff();
+  auto reader = itk::ImageSeriesReader<VolumeImageType>::New();
+  reader->SetImageIO(dicomIO);
+  reader->SetFileNames(strided);
+  reader->MetaDataDictionaryArrayUpdateOff();
+  // the series reader derives Z spacing from the kept slices
+  reader->UpdateOutputInformation();
+  const auto size = reader->GetOutput()->GetLargestPossibleRegion().GetSize();
+
+  // The kept slices are decoded through the cache, so the full build that
+  // follows copies them instead of decoding them again.
+  typename VolumeImageType::Pointer volume;
+  if (size[2] == strided.size()) {
+    volume = VolumeImageType::New();
+    volume->CopyInformation(reader->GetOutput());
+    volume->SetRegions(reader->GetOutput()->GetLargestPossibleRegion());
+    volume->Allocate();
+    TraceScope trace("assembleVolume");
+    assembleSlices<TPixel>(volumeID, slices, size[0] * size[1],
+                           volume->GetBufferPointer(), true);
+  } else {
+    // multi-frame files
+    traceReads(reader, strided);
+    reader->Update();
+    volume = reader->GetOutput();
+  }
+
+  // slices are already strided, so only bin in-plane
+  using ShrinkFilterType = itk::BinShrinkImageFilter<VolumeImageType,
+                                                     VolumeImageType>;
+  auto shrinkFilter = ShrinkFilterType::New();
+  shrinkFilter->SetInput(volume);
+  shrinkFilter->SetShrinkFactor(0, factor);
+  shrinkFilter->SetShrinkFactor(1, factor);
+  shrinkFilter->SetShrinkFactor(2, 1);
+
+  TraceScope trace("writeVolumePreview");
+  shrinkFilter->Update();
+  writeImage<TPixel>(shrinkFilter->GetOutput(), outFileName);
 }
 
-void deleteVolume(const std::string &volumeID) { fs::remove_all(volumeID); }
+// Builds a decimated volume for progressive display: every 2^level-th slice
+// of the sorted series, binned by 2^level in-plane. Level 0 is the same as
+// buildVolume.
+void buildVolumePreview(const std::string &volumeID, unsigned level,
+                        const std::string &outFileName) {
+  if (level == 0) {
+    buildVolume(volumeID, outFileName);
+    return;
+  }
 
-int main(int argc, char *argv[]) {
-  if (argc < 2) {
-    std::cerr << "Usage: " << argv[0] << " [import|clear|remove]" << std::endl;
-    return 1;
+  if (loadVolume(volumeID)) {
+    if (VolumeMap.at(volumeID).empty()) {
+      throw std::runtime_error("No slices in volume " + volumeID);
+    }
+
+    const unsigned factor = 1u << std::min(level, 15u);
+    dispatchComponentType(volumeComponentType(volumeID), [&](auto tag) {
+      using PixelType = typename decltype(tag)::type;
+      writeVolumePreview<PixelType>(volumeID, factor, outFileName);
+    });
+  }
+}
+
+void deleteVolume(const std::string &volumeID) {
+  forgetFiles(volumeID);
+  VolumeMap.erase(volumeID);
+  VolumeIndexMap.erase(volumeID);
+  Thumbnails.erase(volumeID);
+  Slices.erase(volumeID);
+  for (auto &group : VolumeGroups) {
+    group.second.erase(volumeID);
+  }
+  fs::remove_all(volumeID);
+}
+
+// Slice cache counters since the process started, and its current size.
+json cacheStats() {
+  const SliceCacheStats &stats = Slices.stats();
+  return {{"tagHits", stats.tagHits},
+          {"tagMisses", stats.tagMisses},
+          {"pixelHits", stats.pixelHits},
+          {"pixelMisses", stats.pixelMisses},
+          {"evictions", stats.evictions},
+          {"entries", Slices.size()},
+          {"bytes", Slices.bytes()},
+          {"budgetBytes", Slices.budget()}};
+}
+
+// Writes a string result in the format of this invocation. In binary form,
+// each key of an object becomes a string column (a single string becomes a
+// column of one), and an array becomes one column named arrayName.
+void writeResult(const std::string &filename, const json &result,
+                 const std::string &arrayName = "values") {
+  TraceScope trace("writeResult");
+  if (OutputFormat == ResultFormat::Binary) {
+    BinaryResult binary;
+    if (result.is_array()) {
+      binary.addStrings(arrayName, result.get<std::vector<std::string>>());
+    } else if (result.is_object()) {
+      for (const auto &item : result.items()) {
+        const json &value = item.value();
+        binary.addStrings(item.key(),
+                          value.is_array()
+                              ? value.get<std::vector<std::string>>()
+                              : std::vector<std::string>{value.get<std::string>()});
+      }
+    }
+    binary.write(filename);
+    return;
+  }
+
+  std::ofstream outfile;
+  outfile.open(filename);
+  outfile << result.dump(-1, true, ' ', json::error_handler_t::ignore);
+  outfile.close();
+}
+
+void writeTubeTree(const std::string &filename, const TubeTree &tree) {
+  TraceScope trace("writeResult");
+  BinaryResult binary;
+  binary.addArray("ids", tree.ids);
+  binary.addArray("parents", tree.parents);
+  binary.addArray("pointOffsets", tree.pointOffsets);
+  binary.addArray("pointIds", tree.pointIds);
+  binary.addArray("positions", tree.positions);
+  binary.addArray("radii", tree.radii);
+  binary.addArray("colors", tree.colors);
+  binary.write(filename);
+}
+
+// Pulls global options out of argv and applies them. Returns the remaining
+// positional args, program name first.
+std::vector<char *> parseGlobalOptions(int argc, char *argv[]) {
+  // per-invocation options
+  ImportInPlace = false;
+  SlabSize = 0;
+  MemoryLimitMB = 0;
+  OutputFormat = ResultFormat::JSON;
+  RawOutput = false;
+  TraceOutput = TraceMode::Off;
+  TraceFile.clear();
+
+  std::vector<char *> positional;
+  for (int i = 0; i < argc; i++) {
+    std::string arg(argv[i]);
+    if (arg == "--threads" && i + 1 < argc) {
+      NumThreads = std::max(1ul, std::stoul(argv[++i]));
+    } else if (arg == "--cache-size" && i + 1 < argc) {
+      Slices.setBudget(std::stoul(argv[++i]) << 20);
+    } else if (arg == "--in-place") {
+      ImportInPlace = true;
+    } else if (arg == "--raw") {
+      RawOutput = true;
+    } else if (arg == "--format" && i + 1 < argc) {
+      std::string format(argv[++i]);
+      OutputFormat =
+          format == "binary" ? ResultFormat::Binary : ResultFormat::JSON;
+    } else if (arg == "--slab-size" && i + 1 < argc) {
+      SlabSize = std::stoul(argv[++i]);
+    } else if (arg == "--memory-limit" && i + 1 < argc) {
+      MemoryLimitMB = std::stoul(argv[++i]);
+    } else if (arg == "--trace" && i + 1 < argc) {
+      TraceFile = argv[++i];
+      TraceOutput =
+          TraceFile == "summary" ? TraceMode::Summary : TraceMode::Chrome;
+    } else {
+      positional.push_back(argv[i]);
+    }
   }
+  return positional;
+}
 
+// Logs an action's error and records it as the action's result.
+static void actionFailed(const std::string &message) {
+  std::cerr << message << std::endl;
+  ActionError = message;
+}
+
+int runAction(int argc, char *argv[]) {
   std::string action(argv[1]);
 
   // need some IO so emscripten will import FS module
@@ -450,6 +1474,9 @@ int main(int argc, char *argv[]) {
   std::cerr << "Action: " << action << ", runcount: " << ++rc
             << ", argc: " << argc << std::endl;
 
+  ActionError.clear();
+  beginTrace(TraceOutput, action, TraceFile);
+
   if (action == "import" && argc > 2) {
     // dicom import output.json <FILES>
     std::string outFileName = argv[2];
@@ -459,15 +1486,12 @@ int main(int argc, char *argv[]) {
     try {
       importInfo = import(rest);
     } catch (const std::runtime_error &e) {
-      std::cerr << "Runtime error: " << e.what() << std::endl;
+      actionFailed(std::string("Runtime error: ") + e.what());
     } catch (const itk::ExceptionObject &e) {
-      std::cerr << "ITK error: " << e.what() << std::endl;
+      actionFailed(std::string("ITK error: ") + e.what());
     }
 
-    std::ofstream outfile;
-    outfile.open(outFileName);
-    outfile << importInfo.dump(-1, true, ' ', json::error_handler_t::ignore);
-    outfile.close();
+    writeResult(outFileName, importInfo, "volumeIDs");
   } else if (action == "buildVolumeList") {
     // dicom buildVolumeList output.json volumeID
     std::string outFileName(argv[2]);
@@ -476,9 +1500,9 @@ int main(int argc, char *argv[]) {
     try {
       numSlices = buildVolumeList(volumeID);
     } catch (const itk::ExceptionObject &e) {
-      std::cerr << "ITK error: " << e.what() << std::endl;
+      actionFailed(std::string("ITK error: ") + e.what());
     } catch (const std::runtime_error &e) {
-      std::cerr << "Runtime error: " << e.what() << std::endl;
+      actionFailed(std::string("Runtime error: ") + e.what());
     }
 
     std::ofstream outfile;
@@ -496,28 +1520,45 @@ int main(int argc, char *argv[]) {
     try {
       tags = readTags(volumeID, sliceNum, rest);
     } catch (const itk::ExceptionObject &e) {
-      std::cerr << "ITK error: " << e.what() << std::endl;
+      actionFailed(std::string("ITK error: ") + e.what());
     } catch (const std::runtime_error &e) {
-      std::cerr << "Runtime error: " << e.what() << std::endl;
+      actionFailed(std::string("Runtime error: ") + e.what());
     }
 
-    std::ofstream outfile;
-    outfile.open(outputFilename);
-    outfile << tags.dump(-1, true, ' ', json::error_handler_t::ignore);
-    outfile.close();
-  } else if (action == "getSliceImage" && argc == 6) {
-    // dicom getSliceImage outputImage.json volumeID SLICENUM
+    writeResult(outputFilename, tags);
+  } else if (action == "readTagsBatch" && argc > 5) {
+    // dicom readTagsBatch output.json volumeID START END [...tags]
+    std::string outputFilename(argv[2]);
+    std::string volumeID(argv[3]);
+    unsigned long start = std::stoul(argv[4]);
+    unsigned long end = std::stoul(argv[5]);
+    std::vector<std::string> rest(argv + 6, argv + argc);
+
+    json columns;
+    try {
+      columns = readTagsBatch(volumeID, start, end, rest);
+    } catch (const itk::ExceptionObject &e) {
+      actionFailed(std::string("ITK error: ") + e.what());
+    } catch (const std::runtime_error &e) {
+      actionFailed(std::string("Runtime error: ") + e.what());
+    }
+
+    writeResult(outputFilename, columns);
+  } else if (action == "getSliceImage" && (argc == 6 || argc == 7)) {
+    // dicom getSliceImage outputImage.json volumeID SLICENUM ASTHUMB [SIZE]
     std::string outFileName = argv[2];
     std::string volumeID = argv[3];
     unsigned long sliceNum = std::stoul(argv[4]);
     bool asThumbnail = std::string(argv[5]) == "1";
+    unsigned thumbnailSize = argc == 7 ? std::stoul(argv[6]) : 64;
 
     try {
-      getSliceImage(volumeID, sliceNum, outFileName, asThumbnail);
+      getSliceImage(volumeID, sliceNum, outFileName, asThumbnail,
+                    thumbnailSize);
     } catch (const itk::ExceptionObject &e) {
-      std::cerr << "ITK error: " << e.what() << '\n';
+      actionFailed(std::string("ITK error: ") + e.what());
     } catch (const std::runtime_error &e) {
-      std::cerr << "Runtime error: " << e.what() << std::endl;
+      actionFailed(std::string("Runtime error: ") + e.what());
     }
   } else if (action == "buildVolume" && argc == 4) {
     // dicom buildVolume outputImage.json volumeID
@@ -527,30 +1568,100 @@ int main(int argc, char *argv[]) {
     try {
       buildVolume(volumeID, outFileName);
     } catch (const itk::ExceptionObject &e) {
-      std::cerr << "ITK error: " << e.what() << '\n';
+      actionFailed(std::string("ITK error: ") + e.what());
+    } catch (const std::runtime_error &e) {
+      actionFailed(e.what());
+    }
+  } else if (action == "buildVolumePreview" && argc == 5) {
+    // dicom buildVolumePreview outputImage.json volumeID LEVEL
+    std::string outFileName = argv[2];
+    std::string volumeID = argv[3];
+    unsigned level = std::stoul(argv[4]);
+
+    try {
+      buildVolumePreview(volumeID, level, outFileName);
+    } catch (const itk::ExceptionObject &e) {
+      actionFailed(std::string("ITK error: ") + e.what());
     } catch (const std::runtime_error &e) {
-      std::cerr << e.what() << std::endl;
+      actionFailed(e.what());
     }
   } else if (action == "deleteVolume" && argc == 3) {
     // dicom deleteVolume volumeID
-    std::string volumeID(argv[3]);
+    std::string volumeID(argv[2]);
 
     try {
       deleteVolume(volumeID);
     } catch (const std::runtime_error &e) {
-      std::cerr << e.what() << std::endl;
+      actionFailed(e.what());
     }
+  } else if (action == "cacheStats" && argc == 3) {
+    // dicom cacheStats output.json
+    std::ofstream outfile;
+    outfile.open(argv[2]);
+    outfile << cacheStats().dump();
+    outfile.close();
   } else if (action == "readTRE" && argc == 4) {
     // dicom readTRE points.json TRE_FILE
     std::string outFilename = argv[2];
     std::string filename = argv[3];
-    json tre = readTRE(filename);
 
-    std::ofstream outfile;
-    outfile.open(outFilename);
-    outfile << tre.dump();
-    outfile.close();
+    try {
+      if (OutputFormat == ResultFormat::Binary) {
+        TubeTree tree;
+        try {
+          TraceScope trace("readTRE");
+          tree = parseTubeTree(filename);
+        } catch (const std::exception &e) {
+          // content the streaming parser does not handle goes through ITK
+          std::cerr << "readTRE: " << e.what() << "; using ITK reader\n";
+          TraceScope trace("readTRE");
+          tree = readTubeTree(filename);
+        }
+        writeTubeTree(outFilename, tree);
+      } else {
+        json tre;
+        {
+          TraceScope trace("readTRE");
+          tre = readTRE(filename);
+        }
+
+        std::ofstream outfile;
+        outfile.open(outFilename);
+        outfile << tre.dump();
+        outfile.close();
+      }
+    } catch (const itk::ExceptionObject &e) {
+      actionFailed(std::string("ITK error: ") + e.what());
+    } catch (const std::runtime_error &e) {
+      actionFailed(std::string("Runtime error: ") + e.what());
+    }
+  } else {
+    actionFailed("Unknown action or wrong arguments: " + action);
   }
 
-  return 0;
+  endTrace();
+  return ActionError.empty() ? 0 : 1;
+}
+
+#ifndef WEB_BUILD
+// Runs one request of the long-lived server mode. All process state
+// (VolumeMap, indices, thread pool) carries over between requests.
+json handleRequest(const std::vector<std::string> &args) {
+  std::vector<std::string> storage(1, "dicom");
+  storage.insert(storage.end(), args.begin(), args.end());
+  std::vector<char *> argv;
+  for (auto &arg : storage) {
+    argv.push_back(&arg[0]);
+  }
+
+  auto positional = parseGlobalOptions(argv.size(), argv.data());
+  if (positional.size() < 2) {
+    return {{"rc", 1}, {"error", "missing action"}};
+  }
+  int status = runAction(positional.size(), positional.data());
+  if (status != 0) {
+    return {{"rc", status}, {"error", ActionError}};
+  }
+  return {{"rc", status}};
 }
+#endif
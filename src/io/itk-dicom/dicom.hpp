@@ -0,0 +1,30 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+/**
+ * Pulls global options (--threads, --in-place, --format, ...) out of argv
+ * and applies them. Returns the remaining positional args, program name
+ * first.
+ */
+std::vector<char *> parseGlobalOptions(int argc, char *argv[]);
+
+/**
+ * Runs one action. argv holds positional args only, e.g.
+ * ["dicom", "readTags", "output.json", volumeID, "0", ...]. Results are
+ * written to the output file named in the args. Returns 1 if the action
+ * failed or is unknown, 0 otherwise.
+ */
+int runAction(int argc, char *argv[]);
+
+#ifndef WEB_BUILD
+/**
+ * Runs one request of the long-lived server mode: the argv of a regular
+ * invocation without the program name, global options included. Returns
+ * {"rc": exit code}, plus {"error": message} when the action failed.
+ */
+nlohmann::json handleRequest(const std::vector<std::string> &args);
+#endif
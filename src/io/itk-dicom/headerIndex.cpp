@@ -0,0 +1,641 @@
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <unordered_map>
+#include <utility>
+
+#include "gdcmImageHelper.h"
+#include "gdcmReader.h"
+#include "gdcmStringFilter.h"
+#include "gdcmTag.h"
+
+#include "contentHash.hpp"
+#include "headerIndex.hpp"
+#include "threadPool.hpp"
+#include "trace.hpp"
+
+static const double EPSILON = 10e-5;
+// Slices closer than this along the normal, in mm, are at the same position.
+static const double POSITION_EPSILON = 1e-3;
+// Relative difference from the mean gap of a run that ends the run. Positions
+// are DS values, often rounded to 0.01 mm, so gaps of a regular stack jitter
+// by a few percent; a missing slice or a new spacing is well outside this.
+static const double SPACING_TOLERANCE = 0.1;
+
+// Tags appended to the series UID when building the series ID. This is the
+// GDCM default series details restriction, followed by 0008|0021.
+static const std::vector<gdcm::Tag> SeriesDetailTags{
+    gdcm::Tag(0x0020, 0x0011), // Series Number
+    gdcm::Tag(0x0018, 0x0024), // Sequence Name
+    gdcm::Tag(0x0018, 0x0050), // Slice Thickness
+    gdcm::Tag(0x0028, 0x0010), // Rows
+    gdcm::Tag(0x0028, 0x0011), // Columns
+    gdcm::Tag(0x0008, 0x0021), // Series Date
+};
+
+static const gdcm::Tag SOPClassUIDTag(0x0008, 0x0016);
+static const gdcm::Tag SOPInstanceUIDTag(0x0008, 0x0018);
+static const gdcm::Tag SeriesInstanceUIDTag(0x0020, 0x000e);
+static const gdcm::Tag InstanceNumberTag(0x0020, 0x0013);
+static const gdcm::Tag ImagePositionPatientTag(0x0020, 0x0032);
+static const gdcm::Tag ImageOrientationPatientTag(0x0020, 0x0037);
+static const gdcm::Tag RescaleInterceptTag(0x0028, 0x1052);
+static const gdcm::Tag RescaleSlopeTag(0x0028, 0x1053);
+static const gdcm::Tag EchoNumbersTag(0x0018, 0x0086);
+static const gdcm::Tag TriggerTimeTag(0x0018, 0x1060);
+static const gdcm::Tag TemporalPositionIdentifierTag(0x0020, 0x0100);
+
+// Patient, study and series level tags read by the patient browser.
+static const std::vector<std::string> KeyTagNames{
+    "0008|0005", // Specific Character Set
+    "0008|0020", // Study Date
+    "0008|0030", // Study Time
+    "0008|0050", // Accession Number
+    "0008|0060", // Modality
+    "0008|1030", // Study Description
+    "0008|103e", // Series Description
+    "0010|0010", // Patient's Name
+    "0010|0020", // Patient ID
+    "0010|0030", // Patient's Birth Date
+    "0010|0040", // Patient's Sex
+    "0020|000d", // Study Instance UID
+    "0020|000e", // Series Instance UID
+    "0020|0010", // Study ID
+    "0020|0011", // Series Number
+};
+
+static std::vector<gdcm::Tag> parseKeyTags() {
+  std::vector<gdcm::Tag> tags;
+  for (const auto &name : KeyTagNames) {
+    gdcm::Tag tag;
+    tag.ReadFromPipeSeparatedString(name.c_str());
+    tags.push_back(tag);
+  }
+  return tags;
+}
+
+static const std::vector<gdcm::Tag> KeyTags = parseKeyTags();
+
+const std::vector<std::string> &keyTagNames() { return KeyTagNames; }
+
+// All tags needed for a SliceHeader. The reader stops once it is past the
+// largest of these, which is well before the pixel data.
+static std::set<gdcm::Tag> headerTags() {
+  std::set<gdcm::Tag> tags(SeriesDetailTags.begin(), SeriesDetailTags.end());
+  tags.insert(SOPClassUIDTag);
+  tags.insert(SOPInstanceUIDTag);
+  tags.insert(SeriesInstanceUIDTag);
+  tags.insert(InstanceNumberTag);
+  tags.insert(ImagePositionPatientTag);
+  tags.insert(ImageOrientationPatientTag);
+  tags.insert(RescaleInterceptTag);
+  tags.insert(RescaleSlopeTag);
+  tags.insert(EchoNumbersTag);
+  tags.insert(TriggerTimeTag);
+  tags.insert(TemporalPositionIdentifierTag);
+  tags.insert(KeyTags.begin(), KeyTags.end());
+  return tags;
+}
+
+static std::string trim(const std::string &str) {
+  auto start = str.find_first_not_of(" \t\r\n");
+  if (start == std::string::npos) {
+    return {};
+  }
+  auto end = str.find_last_not_of(" \t\r\n");
+  return str.substr(start, end - start + 1);
+}
+
+// Parses a backslash-separated DS/IS value
+static std::vector<double> parseNumbers(const std::string &str) {
+  std::vector<double> values;
+  std::string token;
+  std::istringstream tokStream(str);
+  while (std::getline(tokStream, token, '\\')) {
+    token = trim(token);
+    if (token.empty()) {
+      break;
+    }
+    values.push_back(std::strtod(token.c_str(), nullptr));
+  }
+  return values;
+}
+
+// Same format as gdcm::SerieHelper::CreateUniqueSeriesIdentifier
+static std::string makeSeriesID(const gdcm::File &file,
+                                const gdcm::StringFilter &sf) {
+  const gdcm::DataSet &ds = file.GetDataSet();
+  std::string uid;
+  if (ds.FindDataElement(SeriesInstanceUIDTag)) {
+    uid = sf.ToString(SeriesInstanceUIDTag);
+  }
+
+  std::string id = uid;
+  for (const auto &tag : SeriesDetailTags) {
+    std::string value;
+    if (ds.FindDataElement(tag)) {
+      value = sf.ToString(tag);
+    }
+    if (id == uid && !value.empty()) {
+      id += '.';
+    }
+    id += value;
+  }
+
+  // Eliminate non-alnum characters, including whitespace
+  id.erase(std::remove_if(id.begin(), id.end(),
+                          [](char c) {
+                            return !(c == '.' || (c >= 'a' && c <= 'z') ||
+                                     (c >= '0' && c <= '9') ||
+                                     (c >= 'A' && c <= 'Z'));
+                          }),
+           id.end());
+  return id;
+}
+
+bool readSliceHeader(const std::string &filename, SliceHeader &header) {
+  static const std::set<gdcm::Tag> tags = headerTags();
+  TraceScope trace("readSliceHeader");
+
+  std::ifstream stream(filename, std::ios::binary);
+  gdcm::Reader reader;
+  reader.SetStream(stream);
+  const bool read = reader.ReadSelectedTags(tags);
+  traceFileRead(stream);
+  if (!read) {
+    return false;
+  }
+
+  const gdcm::File &file = reader.GetFile();
+  const gdcm::DataSet &ds = file.GetDataSet();
+  gdcm::StringFilter sf;
+  sf.SetFile(file);
+
+  header.filename = filename;
+  header.seriesID = makeSeriesID(file, sf);
+
+  // UIDs may be padded with a NUL byte
+  header.sopInstanceUID =
+      ds.FindDataElement(SOPInstanceUIDTag)
+          ? trim(std::string(sf.ToString(SOPInstanceUIDTag).c_str()))
+          : "";
+  header.contentHash = 0;
+  if (header.sopInstanceUID.empty() &&
+      !hashFile(filename, header.contentHash)) {
+    return false;
+  }
+  // This helper method asserts that the vector has length 6.
+  header.orientation = gdcm::ImageHelper::GetDirectionCosinesValue(file);
+
+  header.position.clear();
+  if (ds.FindDataElement(ImagePositionPatientTag)) {
+    header.position = parseNumbers(sf.ToString(ImagePositionPatientTag));
+  }
+  header.hasPosition = header.position.size() == 3;
+
+  header.hasInstanceNumber = false;
+  if (ds.FindDataElement(InstanceNumberTag)) {
+    auto value = trim(sf.ToString(InstanceNumberTag));
+    if (!value.empty()) {
+      header.instanceNumber = std::atoi(value.c_str());
+      header.hasInstanceNumber = true;
+    }
+  }
+
+  header.echoNumber = ds.FindDataElement(EchoNumbersTag)
+                          ? trim(sf.ToString(EchoNumbersTag))
+                          : "";
+  header.temporalPosition =
+      ds.FindDataElement(TemporalPositionIdentifierTag)
+          ? trim(sf.ToString(TemporalPositionIdentifierTag))
+          : "";
+  header.triggerTime = 0;
+  if (ds.FindDataElement(TriggerTimeTag)) {
+    auto values = parseNumbers(sf.ToString(TriggerTimeTag));
+    if (!values.empty()) {
+      header.triggerTime = values[0];
+    }
+  }
+
+  header.rescaleIntercept = 0;
+  header.rescaleSlope = 1;
+  if (ds.FindDataElement(RescaleInterceptTag)) {
+    auto values = parseNumbers(sf.ToString(RescaleInterceptTag));
+    if (!values.empty()) {
+      header.rescaleIntercept = values[0];
+    }
+  }
+  if (ds.FindDataElement(RescaleSlopeTag)) {
+    auto values = parseNumbers(sf.ToString(RescaleSlopeTag));
+    if (!values.empty()) {
+      header.rescaleSlope = values[0];
+    }
+  }
+
+  header.keyTags.clear();
+  for (const auto &tag : KeyTags) {
+    header.keyTags.push_back(ds.FindDataElement(tag) ? sf.ToString(tag) : "");
+  }
+
+  return true;
+}
+
+HeaderList scanHeaders(const std::vector<std::string> &filenames,
+                       unsigned numThreads) {
+  TraceScope trace("scanHeaders");
+  // Each file gets its own slot, so the merged result is in input order no
+  // matter which thread parsed which file.
+  HeaderList slots(filenames.size());
+  std::vector<char> readable(filenames.size(), 0);
+
+  sharedThreadPool(numThreads).parallelFor(
+      filenames.size(),
+      [&](size_t i) { readable[i] = readSliceHeader(filenames[i], slots[i]); },
+      8);
+
+  HeaderList headers;
+  headers.reserve(filenames.size());
+  for (size_t i = 0; i < slots.size(); i++) {
+    if (readable[i]) {
+      headers.push_back(std::move(slots[i]));
+    }
+  }
+  return headers;
+}
+
+HeaderMapType SeparateOnSeries(const HeaderList &headers) {
+  TraceScope trace("separateOnSeries");
+  HeaderMapType headerMap;
+  for (const auto &header : headers) {
+    headerMap[header.seriesID].push_back(header);
+  }
+  return headerMap;
+}
+
+static void replaceChars(std::string &str, char search, char replaceChar) {
+  std::replace(str.begin(), str.end(), search, replaceChar);
+}
+
+// row cosine, column cosine
+using Cosines = std::array<double, 6>;
+
+static double dot3(const double *vec1, const double *vec2) {
+  return vec1[0] * vec2[0] + vec1[1] * vec2[1] + vec1[2] * vec2[2];
+}
+
+// True if both the row and the column directions agree within epsilon.
+static bool areCosinesAlmostEqual(const Cosines &cosines1,
+                                  const Cosines &cosines2,
+                                  double epsilon = EPSILON) {
+  return dot3(&cosines1[0], &cosines2[0]) >= 1 - epsilon &&
+         dot3(&cosines1[3], &cosines2[3]) >= 1 - epsilon;
+}
+
+// Grid cell of an orientation, at 1/256 per cosine, packed 10 bits per
+// cosine. Cells are much finer than the matching tolerance, so they are
+// only a hint: slices of one stack share a cell, but two orientations in
+// the same cell still have to be compared.
+static uint64_t orientationCell(const Cosines &cosines) {
+  uint64_t cell = 0;
+  for (double value : cosines) {
+    const double clamped = std::max(-1.0, std::min(1.0, value));
+    cell = (cell << 10) | uint64_t(std::lround(clamped * 256) + 256);
+  }
+  return cell;
+}
+
+HeaderMapType SeparateOnImageOrientation(const HeaderMapType &headerMap) {
+  TraceScope trace("separateOnImageOrientation");
+  HeaderMapType newHeaderMap;
+
+  // append unique ID part to the volume ID, based on cosines
+  // The format replaces non-alphanumeric chars to be semi-consistent with DICOM
+  // UID spec,
+  //   and to make debugging easier when looking at the full volume IDs.
+  // Format: COSINE || "S" || COSINE || "S" || ...
+  //   COSINE: A decimal number -DD.DDDD gets reformatted into NDDSDDDD
+  auto encodeCosinesAsIDPart = [](const Cosines &cosines) {
+    std::string concatenated;
+    for (auto it = cosines.begin(); it != cosines.end(); ++it) {
+      concatenated += std::to_string(*it);
+      if (it != cosines.end() - 1) {
+        concatenated += 'S';
+      }
+    }
+
+    replaceChars(concatenated, '-', 'N');
+    replaceChars(concatenated, '.', 'D');
+
+    return concatenated;
+  };
+
+  // Orientations of the current series, in order of first appearance. A
+  // slice joins the first one it matches, as with a linear scan, but most
+  // slices are placed by one hash lookup and one comparison.
+  struct Cluster {
+    Cosines cosines;
+    HeaderList *headers;
+  };
+  std::vector<Cluster> clusters;
+  // grid cell -> cluster the first slice in that cell joined
+  std::unordered_map<uint64_t, size_t> cellToCluster;
+
+  for (const auto &[volumeID, headers] : headerMap) {
+    // slices are only grouped with slices of the same series
+    clusters.clear();
+    cellToCluster.clear();
+
+    for (const auto &header : headers) {
+      // always 6 values, see readSliceHeader
+      Cosines cosines;
+      std::copy_n(header.orientation.begin(), 6, cosines.begin());
+      const uint64_t cell = orientationCell(cosines);
+
+      auto hint = cellToCluster.find(cell);
+      size_t match = clusters.size();
+      if (hint != cellToCluster.end() &&
+          areCosinesAlmostEqual(cosines, clusters[hint->second].cosines)) {
+        match = hint->second;
+      } else {
+        for (size_t i = 0; i < clusters.size(); i++) {
+          if (areCosinesAlmostEqual(cosines, clusters[i].cosines)) {
+            match = i;
+            break;
+          }
+        }
+        if (match == clusters.size()) {
+          auto newID = volumeID + '.' + encodeCosinesAsIDPart(cosines);
+          clusters.push_back({cosines, &newHeaderMap[newID]});
+        }
+        cellToCluster.emplace(cell, match);
+      }
+
+      clusters[match].headers->push_back(header);
+    }
+  }
+
+  return newHeaderMap;
+}
+
+// Distance of a slice along the normal of the given orientation.
+static double distanceAlongNormal(const std::vector<double> &cosines,
+                                  const std::vector<double> &position) {
+  const double normal[3] = {
+      cosines[1] * cosines[5] - cosines[2] * cosines[4],
+      cosines[2] * cosines[3] - cosines[0] * cosines[5],
+      cosines[0] * cosines[4] - cosines[1] * cosines[3],
+  };
+  return normal[0] * position[0] + normal[1] * position[1] +
+         normal[2] * position[2];
+}
+
+// Keeps [0-9A-Za-z] of a tag value, for use in a volume ID.
+static std::string idPart(const std::string &value) {
+  std::string part;
+  for (char c : value) {
+    if ((c >= '0' && c <= '9') || (c >= 'A' && c <= 'Z') ||
+        (c >= 'a' && c <= 'z')) {
+      part += c;
+    }
+  }
+  return part;
+}
+
+using VolumeParts = std::vector<std::pair<std::string, HeaderList>>;
+
+// Splits on echo number and temporal position, when a volume has more than
+// one of either. Suffixes are .E<echo> and .T<position>.
+static VolumeParts splitOnTemporalTags(const std::string &volumeID,
+                                       const HeaderList &headers) {
+  std::map<std::pair<std::string, std::string>, HeaderList> groups;
+  std::set<std::string> echoes, positions;
+  for (const auto &header : headers) {
+    groups[{header.echoNumber, header.temporalPosition}].push_back(header);
+    echoes.insert(header.echoNumber);
+    positions.insert(header.temporalPosition);
+  }
+  if (groups.size() == 1) {
+    return {{volumeID, headers}};
+  }
+
+  VolumeParts parts;
+  for (auto &[key, group] : groups) {
+    std::string id = volumeID;
+    if (echoes.size() > 1) {
+      id += ".E" + idPart(key.first);
+    }
+    if (positions.size() > 1) {
+      id += ".T" + idPart(key.second);
+    }
+    parts.emplace_back(id, std::move(group));
+  }
+  return parts;
+}
+
+/**
+ * Splits a stack on its geometry, from positions projected on the slice
+ * normal:
+ * - Repeated positions (time series without temporal tags) become separate
+ *   volumes .D1, .D2, ... The n-th slice at each position, ordered by
+ *   trigger time and instance number, goes to volume n.
+ * - Each of those is cut at every gap that differs from the spacing before
+ *   it, e.g. from a missing slice or a new spacing, into evenly spaced
+ *   .S1, .S2, ...
+ *
+ * Volumes without a position on every slice are left as they are, since
+ * sortSlices falls back to other orderings for them.
+ */
+static VolumeParts splitOnPositions(const std::string &volumeID,
+                                    HeaderList headers) {
+  if (headers.empty()) {
+    return {};
+  }
+  for (const auto &header : headers) {
+    if (!header.hasPosition || header.orientation.size() != 6) {
+      return {{volumeID, std::move(headers)}};
+    }
+  }
+
+  const auto &cosines = headers.front().orientation;
+  std::vector<std::pair<double, size_t>> order;
+  order.reserve(headers.size());
+  for (size_t i = 0; i < headers.size(); i++) {
+    order.emplace_back(distanceAlongNormal(cosines, headers[i].position), i);
+  }
+  std::sort(order.begin(), order.end(),
+            [&](const auto &a, const auto &b) {
+              if (a.first != b.first) {
+                return a.first < b.first;
+              }
+              const SliceHeader &ha = headers[a.second];
+              const SliceHeader &hb = headers[b.second];
+              if (ha.triggerTime != hb.triggerTime) {
+                return ha.triggerTime < hb.triggerTime;
+              }
+              return ha.instanceNumber < hb.instanceNumber;
+            });
+
+  // stacks[n] gets the n-th slice at each distinct position
+  std::vector<std::vector<std::pair<double, size_t>>> stacks(1);
+  size_t repeat = 0;
+  for (size_t i = 0; i < order.size(); i++) {
+    const bool samePosition =
+        i > 0 && order[i].first - order[i - 1].first < POSITION_EPSILON;
+    repeat = samePosition ? repeat + 1 : 0;
+    if (repeat == stacks.size()) {
+      stacks.emplace_back();
+    }
+    stacks[repeat].push_back(order[i]);
+  }
+
+  VolumeParts parts;
+  for (size_t n = 0; n < stacks.size(); n++) {
+    const auto &stack = stacks[n];
+    const std::string stackID =
+        stacks.size() > 1 ? volumeID + ".D" + std::to_string(n + 1)
+                          : volumeID;
+
+    // gaps[i] is between slices i and i + 1
+    std::vector<double> gaps;
+    for (size_t i = 1; i < stack.size(); i++) {
+      gaps.push_back(stack[i].first - stack[i - 1].first);
+    }
+
+    // Runs of equal gaps. Any gap that differs from the mean gap of its run
+    // ends the run, so a missing slice or a lone odd gap splits the stack
+    // into parts that are each evenly spaced.
+    std::vector<size_t> runStarts{0};
+    double runSum = 0;
+    size_t runCount = 0;
+    for (size_t i = 0; i < gaps.size(); i++) {
+      if (runCount > 0) {
+        const double spacing = runSum / runCount;
+        if (std::abs(gaps[i] - spacing) >
+            std::max(POSITION_EPSILON, SPACING_TOLERANCE * spacing)) {
+          // the odd gap is between the runs, not in either
+          runStarts.push_back(i + 1);
+          runSum = 0;
+          runCount = 0;
+          continue;
+        }
+      }
+      runSum += gaps[i];
+      runCount++;
+    }
+    runStarts.push_back(stack.size());
+
+    for (size_t r = 0; r + 1 < runStarts.size(); r++) {
+      std::string id = stackID;
+      if (runStarts.size() > 2) {
+        id += ".S" + std::to_string(r + 1);
+      }
+      HeaderList run;
+      for (size_t i = runStarts[r]; i < runStarts[r + 1]; i++) {
+        run.push_back(std::move(headers[stack[i].second]));
+      }
+      parts.emplace_back(id, std::move(run));
+    }
+  }
+  return parts;
+}
+
+HeaderMapType SeparateOnGeometry(const HeaderMapType &headerMap) {
+  TraceScope trace("separateOnGeometry");
+  HeaderMapType newHeaderMap;
+  for (const auto &[volumeID, headers] : headerMap) {
+    for (auto &[tagID, tagHeaders] : splitOnTemporalTags(volumeID, headers)) {
+      for (auto &[id, part] : splitOnPositions(tagID, std::move(tagHeaders))) {
+        auto &target = newHeaderMap[id];
+        target.insert(target.end(), std::make_move_iterator(part.begin()),
+                      std::make_move_iterator(part.end()));
+      }
+    }
+  }
+  return newHeaderMap;
+}
+
+// Mirrors gdcm::SerieHelper::ImagePositionPatientOrdering. Fails if any
+// slice has no position, or if two slices share a position.
+static bool sortByPosition(HeaderList &headers) {
+  if (headers.empty()) {
+    return false;
+  }
+
+  // slice normal from the first slice
+  const auto &cosines = headers.front().orientation;
+  double normal[3] = {
+      cosines[1] * cosines[5] - cosines[2] * cosines[4],
+      cosines[2] * cosines[3] - cosines[0] * cosines[5],
+      cosines[0] * cosines[4] - cosines[1] * cosines[3],
+  };
+
+  std::vector<std::pair<double, size_t>> distances;
+  distances.reserve(headers.size());
+  for (size_t i = 0; i < headers.size(); i++) {
+    const auto &header = headers[i];
+    if (!header.hasPosition) {
+      return false;
+    }
+    double dist = 0;
+    for (int j = 0; j < 3; j++) {
+      dist += normal[j] * header.position[j];
+    }
+    distances.emplace_back(dist, i);
+  }
+
+  std::sort(distances.begin(), distances.end());
+  for (size_t i = 1; i < distances.size(); i++) {
+    if (distances[i].first == distances[i - 1].first) {
+      return false;
+    }
+  }
+
+  HeaderList sorted;
+  sorted.reserve(headers.size());
+  for (const auto &entry : distances) {
+    sorted.push_back(std::move(headers[entry.second]));
+  }
+  headers.swap(sorted);
+  return true;
+}
+
+static bool sortByInstanceNumber(HeaderList &headers) {
+  for (const auto &header : headers) {
+    if (!header.hasInstanceNumber) {
+      return false;
+    }
+  }
+  std::stable_sort(headers.begin(), headers.end(),
+                   [](const SliceHeader &a, const SliceHeader &b) {
+                     return a.instanceNumber < b.instanceNumber;
+                   });
+  return true;
+}
+
+std::string contentKey(const SliceHeader &header) {
+  if (!header.sopInstanceUID.empty()) {
+    return header.sopInstanceUID;
+  }
+  // UIDs are digits and dots only, so this cannot collide with one
+  char hex[24];
+  std::snprintf(hex, sizeof(hex), "xxh64:%016llx",
+                static_cast<unsigned long long>(header.contentHash));
+  return hex;
+}
+
+void sortSlices(HeaderList &headers) {
+  if (sortByPosition(headers) || sortByInstanceNumber(headers)) {
+    return;
+  }
+  std::sort(headers.begin(), headers.end(),
+            [](const SliceHeader &a, const SliceHeader &b) {
+              return a.filename < b.filename;
+            });
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * The subset of a DICOM file's header that import needs in order to split
+ * files into volumes and to order the slices of each volume.
+ */
+struct SliceHeader {
+  std::string filename;
+  // 0008|0018, trimmed; empty if absent
+  std::string sopInstanceUID;
+  // XXH64 of the whole file, only computed when it has no SOP Instance UID
+  uint64_t contentHash = 0;
+  // Series UID refined with the series details and 0008|0021, in the same
+  // format as GDCMSeriesFileNames::GetSeriesUIDs().
+  std::string seriesID;
+  // 0020|0037, always 6 values
+  std::vector<double> orientation;
+  // 0020|0032, 3 values if present
+  std::vector<double> position;
+  // 0020|0013
+  int instanceNumber = 0;
+  // 0028|1052 and 0028|1053
+  double rescaleIntercept = 0;
+  double rescaleSlope = 1;
+  bool hasPosition = false;
+  bool hasInstanceNumber = false;
+  // 0018|0086 and 0020|0100, empty if absent. More than one value in a
+  // series means separate echoes or time points.
+  std::string echoNumber;
+  std::string temporalPosition;
+  // 0018|1060, orders slices that share a position
+  double triggerTime = 0;
+  // raw values of keyTagNames(), in the same order
+  std::vector<std::string> keyTags;
+};
+
+using HeaderList = std::vector<SliceHeader>;
+// volumeID -> headers
+using HeaderMapType = std::unordered_map<std::string, HeaderList>;
+
+/**
+ * Tags that are captured during the header scan so that volume-level
+ * metadata can be served without opening the files again. Includes the
+ * SpecificCharacterSet so values can be converted later.
+ */
+const std::vector<std::string> &keyTagNames();
+
+/**
+ * Reads only the header elements needed for a SliceHeader. Parsing stops
+ * before the pixel data.
+ *
+ * Returns false if the file is not a readable DICOM file.
+ */
+bool readSliceHeader(const std::string &filename, SliceHeader &header);
+
+/**
+ * Reads the headers of all given files over numThreads threads. Unreadable
+ * files are skipped. The result is in the same order as filenames.
+ */
+HeaderList scanHeaders(const std::vector<std::string> &filenames,
+                       unsigned numThreads = 1);
+
+/**
+ * Groups headers by their series ID.
+ */
+HeaderMapType SeparateOnSeries(const HeaderList &headers);
+
+/**
+ * Further splits each volume on image orientation. The resulting volume IDs
+ * are the input volume IDs with an encoded orientation appended.
+ */
+HeaderMapType SeparateOnImageOrientation(const HeaderMapType &headerMap);
+
+/**
+ * Splits volumes that are not one regular 3D stack: by echo number and
+ * temporal position, then by repeated slice positions, then wherever the
+ * slice gap changes. Each piece gets its own volume ID, the input ID plus a
+ * suffix (.E<n>, .T<n>, .D<n>, .S<n>); pieces of a 4D series share the
+ * input ID as a prefix. Regular stacks keep their ID.
+ */
+HeaderMapType SeparateOnGeometry(const HeaderMapType &headerMap);
+
+/**
+ * Identifies a file's content for deduplication: its SOP Instance UID, or
+ * its content hash when it has none.
+ */
+std::string contentKey(const SliceHeader &header);
+
+/**
+ * Orders slices the same way GDCMSeriesFileNames does: by position along the
+ * slice normal, then by instance number, then by filename.
+ */
+void sortSlices(HeaderList &headers);
@@ -0,0 +1,47 @@
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#ifdef WEB_BUILD
+#include <emscripten.h>
+#endif
+
+#include "dicom.hpp"
+#ifndef WEB_BUILD
+#include "server.hpp"
+#endif
+
+#ifdef WEB_BUILD
+extern "C" const char *EMSCRIPTEN_KEEPALIVE unpack_error_what(intptr_t ptr) {
+  auto error = reinterpret_cast<std::runtime_error *>(ptr);
+  return error->what();
+}
+#endif
+
+int main(int argc, char *argv[]) {
+  // pull out global options so the actions only see positional args
+  std::vector<char *> positional = parseGlobalOptions(argc, argv);
+  argc = positional.size();
+  argv = positional.data();
+
+  if (argc < 2) {
+    std::cerr << "Usage: " << argv[0]
+              << " [--threads N] [--in-place] [--raw] [--slab-size N]"
+              << " [--memory-limit MB] [--format json|binary]"
+              << " [--trace summary|FILE] [--cache-size MB]"
+              << " [import|clear|remove|serve]"
+              << std::endl;
+    return 1;
+  }
+
+#ifndef WEB_BUILD
+  if (std::string(argv[1]) == "serve") {
+    // dicom serve [SOCKET_PATH]
+    std::string socketPath = argc > 2 ? argv[2] : "";
+    return serve(handleRequest, socketPath);
+  }
+#endif
+
+  return runAction(argc, argv);
+}
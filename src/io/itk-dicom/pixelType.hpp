@@ -0,0 +1,73 @@
+#pragma once
+
+#include <type_traits>
+
+#include "itkCommonEnums.h"
+
+/**
+ * Carries a pixel type through a generic lambda, e.g.
+ *
+ *   dispatchComponentType(type, [&](auto tag) {
+ *     using PixelType = typename decltype(tag)::type;
+ *     ...
+ *   });
+ */
+template <typename T> struct PixelTypeTag { using type = T; };
+
+/**
+ * Calls fn with the PixelTypeTag matching an ITK component type. Types with
+ * no DICOM counterpart fall back to float.
+ */
+template <typename TFunc>
+void dispatchComponentType(itk::IOComponentEnum componentType, TFunc &&fn) {
+  switch (componentType) {
+  case itk::IOComponentEnum::UCHAR:
+    fn(PixelTypeTag<unsigned char>());
+    break;
+  case itk::IOComponentEnum::CHAR:
+    fn(PixelTypeTag<signed char>());
+    break;
+  case itk::IOComponentEnum::USHORT:
+    fn(PixelTypeTag<unsigned short>());
+    break;
+  case itk::IOComponentEnum::SHORT:
+    fn(PixelTypeTag<short>());
+    break;
+  case itk::IOComponentEnum::UINT:
+    fn(PixelTypeTag<unsigned int>());
+    break;
+  case itk::IOComponentEnum::INT:
+    fn(PixelTypeTag<int>());
+    break;
+  case itk::IOComponentEnum::DOUBLE:
+    fn(PixelTypeTag<double>());
+    break;
+  case itk::IOComponentEnum::FLOAT:
+  default:
+    fn(PixelTypeTag<float>());
+    break;
+  }
+}
+
+/**
+ * The component type dispatchComponentType maps to T.
+ */
+template <typename T> constexpr itk::IOComponentEnum componentTypeOf() {
+  if constexpr (std::is_same_v<T, unsigned char>) {
+    return itk::IOComponentEnum::UCHAR;
+  } else if constexpr (std::is_same_v<T, signed char>) {
+    return itk::IOComponentEnum::CHAR;
+  } else if constexpr (std::is_same_v<T, unsigned short>) {
+    return itk::IOComponentEnum::USHORT;
+  } else if constexpr (std::is_same_v<T, short>) {
+    return itk::IOComponentEnum::SHORT;
+  } else if constexpr (std::is_same_v<T, unsigned int>) {
+    return itk::IOComponentEnum::UINT;
+  } else if constexpr (std::is_same_v<T, int>) {
+    return itk::IOComponentEnum::INT;
+  } else if constexpr (std::is_same_v<T, double>) {
+    return itk::IOComponentEnum::DOUBLE;
+  } else {
+    return itk::IOComponentEnum::FLOAT;
+  }
+}
@@ -0,0 +1,162 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <utility>
+
+#ifndef WEB_BUILD
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include "rawVolume.hpp"
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#error "RawVolumeFile writes host byte order, which must be little-endian"
+#endif
+
+namespace {
+
+// PixelType and size of a component type
+std::pair<RawVolumeFile::PixelType, uint32_t>
+pixelTypeOf(itk::IOComponentEnum componentType) {
+  switch (componentType) {
+  case itk::IOComponentEnum::UCHAR:
+    return {RawVolumeFile::UInt8, 1};
+  case itk::IOComponentEnum::CHAR:
+    return {RawVolumeFile::Int8, 1};
+  case itk::IOComponentEnum::USHORT:
+    return {RawVolumeFile::UInt16, 2};
+  case itk::IOComponentEnum::SHORT:
+    return {RawVolumeFile::Int16, 2};
+  case itk::IOComponentEnum::UINT:
+    return {RawVolumeFile::UInt32, 4};
+  case itk::IOComponentEnum::INT:
+    return {RawVolumeFile::Int32, 4};
+  case itk::IOComponentEnum::FLOAT:
+    return {RawVolumeFile::Float32, 4};
+  case itk::IOComponentEnum::DOUBLE:
+    return {RawVolumeFile::Float64, 8};
+  default:
+    throw std::runtime_error("Raw volumes cannot hold this pixel type");
+  }
+}
+
+template <typename T> char *put(char *out, const T *values, size_t count) {
+  std::memcpy(out, values, sizeof(T) * count);
+  return out + sizeof(T) * count;
+}
+
+} // namespace
+
+RawVolumeFile::RawVolumeFile(const std::string &filename,
+                             const RawVolumeInfo &info)
+    : m_filename(filename) {
+  const auto [pixelType, pixelBytes] = pixelTypeOf(info.componentType);
+  m_length = HeaderSize + size_t(pixelBytes) * info.size[0] * info.size[1] *
+                              info.size[2];
+
+  char header[HeaderSize] = {};
+  const uint32_t fields[3] = {Version, pixelType, pixelBytes};
+  char *out = put(header, Magic, 4);
+  out = put(out, fields, 3);
+  out = put(out, info.size, 3);
+  out = put(out, info.spacing, 3);
+  out = put(out, info.origin, 3);
+  put(out, info.direction, 9);
+
+#ifndef WEB_BUILD
+  int fd = open(filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0666);
+  if (fd < 0) {
+    throw std::runtime_error("Cannot create " + filename + ": " +
+                             std::strerror(errno));
+  }
+  // the file is sparse until pixels are written
+  if (ftruncate(fd, m_length) == 0) {
+    void *addr =
+        mmap(nullptr, m_length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (addr != MAP_FAILED) {
+      m_data = static_cast<char *>(addr);
+      m_mapped = true;
+    }
+  }
+  ::close(fd);
+#endif
+
+  if (m_mapped) {
+    std::memcpy(m_data, header, HeaderSize);
+    return;
+  }
+
+  m_out.open(filename, std::ios::binary | std::ios::trunc);
+  m_out.write(header, HeaderSize);
+  if (!m_out) {
+    throw std::runtime_error("Cannot create " + filename);
+  }
+}
+
+RawVolumeFile::~RawVolumeFile() {
+  try {
+    this->close();
+  } catch (const std::runtime_error &) {
+  }
+}
+
+void *RawVolumeFile::pixels() {
+  if (m_mapped) {
+    return m_data + HeaderSize;
+  }
+  if (m_buffer.empty()) {
+    m_buffer.resize(this->pixelsLength());
+  }
+  return m_buffer.data();
+}
+
+void RawVolumeFile::writePixels(size_t offset, const void *data,
+                                size_t length) {
+  if (m_closed || offset + length > this->pixelsLength()) {
+    throw std::runtime_error("Pixels do not fit in " + m_filename);
+  }
+  if (m_mapped || !m_buffer.empty()) {
+    std::memcpy(static_cast<char *>(this->pixels()) + offset, data, length);
+    return;
+  }
+  m_out.seekp(HeaderSize + offset);
+  m_out.write(static_cast<const char *>(data), length);
+  m_written = std::max(m_written, offset + length);
+  if (!m_out) {
+    throw std::runtime_error("Cannot write " + m_filename);
+  }
+}
+
+void RawVolumeFile::close() {
+  if (m_closed) {
+    return;
+  }
+  m_closed = true;
+
+#ifndef WEB_BUILD
+  if (m_mapped) {
+    // the page cache has the pixels; the file is complete once unmapped
+    munmap(m_data, m_length);
+    m_data = nullptr;
+    return;
+  }
+#endif
+
+  if (!m_buffer.empty()) {
+    m_out.write(m_buffer.data(), m_buffer.size());
+    m_buffer.clear();
+    m_buffer.shrink_to_fit();
+  } else if (m_written < this->pixelsLength()) {
+    // pixels never written stay zero
+    m_out.seekp(m_length - 1);
+    m_out.put(0);
+  }
+  m_out.close();
+  if (!m_out) {
+    throw std::runtime_error("Cannot write " + m_filename);
+  }
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "itkCommonEnums.h"
+
+/**
+ * Geometry and pixel type of a raw volume file.
+ */
+struct RawVolumeInfo {
+  itk::IOComponentEnum componentType = itk::IOComponentEnum::UCHAR;
+  uint64_t size[3] = {1, 1, 1};
+  double spacing[3] = {1, 1, 1};
+  double origin[3] = {0, 0, 0};
+  // row-major
+  double direction[9] = {1, 0, 0, 0, 1, 0, 0, 0, 1};
+};
+
+/**
+ * A volume written as a small header followed by its pixels, so a reader
+ * can map the file and view the pixels as a typed array without copying.
+ *
+ * Layout (all numbers little-endian):
+ *
+ *   header  char magic[4] = "PVMV", uint32 version, uint32 pixelType,
+ *           uint32 pixelBytes, uint64 size[3], float64 spacing[3],
+ *           float64 origin[3], float64 direction[9] (row-major), zero
+ *           padding up to HeaderSize
+ *   pixels  size[0] * size[1] * size[2] values, x fastest
+ *
+ * pixelType is one of PixelType below.
+ *
+ * Natively the file is created at full size and mapped, and pixels are
+ * decoded straight into the mapping. Where mmap is unavailable (the Wasm
+ * build's in-memory file system) writePixels() writes through to the file,
+ * so callers can fill it a slab at a time; pixels() instead buffers the
+ * whole volume on the heap until close().
+ */
+class RawVolumeFile {
+public:
+  enum PixelType : uint32_t {
+    UInt8 = 1,
+    Int8 = 2,
+    UInt16 = 3,
+    Int16 = 4,
+    UInt32 = 5,
+    Int32 = 6,
+    Float32 = 7,
+    Float64 = 8,
+  };
+
+  static constexpr char Magic[4] = {'P', 'V', 'M', 'V'};
+  static constexpr uint32_t Version = 1;
+  // keeps the pixels 64-byte aligned in the file
+  static constexpr size_t HeaderSize = 256;
+
+  // Creates the file with its header. Throws std::runtime_error if it
+  // cannot be created or the pixel type has no PixelType.
+  RawVolumeFile(const std::string &filename, const RawVolumeInfo &info);
+  // Closes the file if close() was not called, ignoring errors.
+  ~RawVolumeFile();
+
+  RawVolumeFile(const RawVolumeFile &) = delete;
+  RawVolumeFile &operator=(const RawVolumeFile &) = delete;
+
+  // Whether pixels() is the file itself rather than a heap buffer.
+  bool mapped() const { return m_mapped; }
+
+  // All of the pixels, for callers that fill them in place. Unmapped, the
+  // first call allocates the heap buffer.
+  void *pixels();
+  size_t pixelsLength() const { return m_length - HeaderSize; }
+
+  // Copies length bytes of pixels to byte offset in the pixel data. Throws
+  // std::runtime_error if they do not fit or cannot be written.
+  void writePixels(size_t offset, const void *data, size_t length);
+
+  // Unmaps, or writes out the heap buffer. Throws std::runtime_error if the
+  // file cannot be written.
+  void close();
+
+private:
+  std::string m_filename;
+  // the mapped file, header included
+  char *m_data = nullptr;
+  size_t m_length = 0;
+  bool m_mapped = false;
+  bool m_closed = false;
+  // end of the pixels writePixels() has streamed out so far
+  size_t m_written = 0;
+  std::ofstream m_out;
+  std::vector<char> m_buffer;
+};
@@ -1,4 +1,5 @@
 #include <iostream>
+#include <utility>
 
 #include "readTRE.hpp"
 
@@ -16,7 +17,7 @@ json serializeTree(const SpatialObjectType::Pointer &so) {
   if (tube != nullptr) {
     json pointList = json::array();
 
-    TubeType::TubePointListType points = tube->GetPoints();
+    const TubeType::TubePointListType &points = tube->GetPoints();
     for (auto it = points.begin(); it != points.end(); ++it) {
       json pointData;
       auto point = *it;
@@ -66,3 +67,67 @@ json readTRE(const std::string &filename) {
   auto group = reader->GetGroup();
   return serializeTree(group);
 }
+
+TubeTree flattenTubeTree(const SpatialObjectType *root) {
+  TubeTree tree;
+  tree.pointOffsets.push_back(0);
+
+  // Depth-first with an explicit stack, visiting children in order like
+  // serializeTree. Children are pushed in reverse so the first pops first.
+  std::vector<std::pair<const SpatialObjectType *, int32_t>> stack;
+  stack.emplace_back(root, -1);
+  SpatialObjectType::ChildrenListType children;
+
+  while (!stack.empty()) {
+    const SpatialObjectType *so = stack.back().first;
+    const int32_t parent = stack.back().second;
+    stack.pop_back();
+
+    const int32_t index = tree.ids.size();
+    tree.ids.push_back(so->GetId());
+    tree.parents.push_back(parent);
+
+    const auto *tube = dynamic_cast<const TubeType *>(so);
+    if (tube != nullptr) {
+      const TubeType::TubePointListType &points = tube->GetPoints();
+      const size_t first = tree.pointIds.size();
+      const size_t count = first + points.size();
+      tree.pointIds.resize(count);
+      tree.positions.resize(count * 3);
+      tree.radii.resize(count);
+      tree.colors.resize(count * 4);
+
+      for (size_t i = first; i < count; i++) {
+        const TubePointType &point = points[i - first];
+        const auto pos = point.GetPositionInWorldSpace();
+        tree.pointIds[i] = point.GetId();
+        tree.positions[3 * i + 0] = pos[0];
+        tree.positions[3 * i + 1] = pos[1];
+        tree.positions[3 * i + 2] = pos[2];
+        tree.radii[i] = point.GetRadiusInWorldSpace();
+        tree.colors[4 * i + 0] = point.GetRed();
+        tree.colors[4 * i + 1] = point.GetGreen();
+        tree.colors[4 * i + 2] = point.GetBlue();
+        tree.colors[4 * i + 3] = point.GetAlpha();
+      }
+    }
+    tree.pointOffsets.push_back(tree.pointIds.size());
+
+    // direct children only; one list is reused for every object
+    children.clear();
+    so->AddChildrenToList(&children, 0);
+    for (auto it = children.rbegin(); it != children.rend(); ++it) {
+      stack.emplace_back(it->GetPointer(), index);
+    }
+  }
+
+  return tree;
+}
+
+TubeTree readTubeTree(const std::string &filename) {
+  ReaderType::Pointer reader = ReaderType::New();
+  reader->SetFileName(filename);
+  reader->Update();
+
+  return flattenTubeTree(reader->GetGroup());
+}
@@ -1,3 +1,8 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
 #include <nlohmann/json.hpp>
 
 #include "itkSpatialObjectReader.h"
@@ -6,3 +11,30 @@
 using json = nlohmann::json;
 
 json readTRE(const std::string &filename);
+
+/**
+ * The spatial objects of a TRE file, flattened in depth-first order. Tube
+ * points of object i are [pointOffsets[i], pointOffsets[i + 1]). Non-tube
+ * objects (e.g. groups) have no points.
+ */
+struct TubeTree {
+  // per object
+  std::vector<int32_t> ids;
+  // index of the parent object, -1 for the root
+  std::vector<int32_t> parents;
+  // objects + 1 entries
+  std::vector<uint32_t> pointOffsets;
+
+  // per point, in world space
+  std::vector<int32_t> pointIds;
+  std::vector<float> positions; // x, y, z
+  std::vector<float> radii;
+  std::vector<float> colors; // r, g, b, a
+};
+
+/**
+ * Reads a TRE file into a TubeTree. The hierarchy is walked iteratively and
+ * points are written straight into the arrays, so large vessel trees do not
+ * create per-point objects the way readTRE does.
+ */
+TubeTree readTubeTree(const std::string &filename);
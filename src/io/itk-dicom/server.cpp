@@ -0,0 +1,152 @@
+#include <cerrno>
+#include <csignal>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "server.hpp"
+
+using json = nlohmann::json;
+
+// Largest message accepted. Requests are argv arrays, so this is far above
+// anything legitimate and only guards against garbage length prefixes.
+static constexpr uint32_t MaxMessageSize = 64u << 20;
+
+// Returns false on EOF or error before count bytes were read.
+static bool readAll(int fd, char *buf, size_t count) {
+  while (count > 0) {
+    ssize_t n = read(fd, buf, count);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    buf += n;
+    count -= n;
+  }
+  return true;
+}
+
+static bool writeAll(int fd, const char *buf, size_t count) {
+  while (count > 0) {
+    ssize_t n = write(fd, buf, count);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    buf += n;
+    count -= n;
+  }
+  return true;
+}
+
+static bool readMessage(int fd, std::string &message) {
+  unsigned char prefix[4];
+  if (!readAll(fd, reinterpret_cast<char *>(prefix), 4)) {
+    return false;
+  }
+  uint32_t length = prefix[0] | (prefix[1] << 8) | (prefix[2] << 16) |
+                    (uint32_t(prefix[3]) << 24);
+  if (length > MaxMessageSize) {
+    std::cerr << "Message of " << length << " bytes is too large" << std::endl;
+    return false;
+  }
+  message.resize(length);
+  return readAll(fd, &message[0], length);
+}
+
+static bool writeMessage(int fd, const std::string &message) {
+  uint32_t length = message.size();
+  unsigned char prefix[4] = {
+      static_cast<unsigned char>(length & 0xff),
+      static_cast<unsigned char>((length >> 8) & 0xff),
+      static_cast<unsigned char>((length >> 16) & 0xff),
+      static_cast<unsigned char>((length >> 24) & 0xff),
+  };
+  return writeAll(fd, reinterpret_cast<char *>(prefix), 4) &&
+         writeAll(fd, message.data(), message.size());
+}
+
+// Serves one stream. Returns false if the peer asked to quit.
+static bool serveStream(const RequestHandler &handler, int inFd, int outFd) {
+  std::string message;
+  while (readMessage(inFd, message)) {
+    json response;
+    try {
+      auto args = json::parse(message).get<std::vector<std::string>>();
+      if (args.size() == 1 && args[0] == "quit") {
+        writeMessage(outFd, json({{"rc", 0}}).dump());
+        return false;
+      }
+      response = handler(args);
+    } catch (const std::exception &e) {
+      response = {{"rc", 1}, {"error", e.what()}};
+    }
+
+    if (!writeMessage(outFd, response.dump(-1, ' ', false,
+                                           json::error_handler_t::ignore))) {
+      break;
+    }
+  }
+  return true;
+}
+
+int serve(const RequestHandler &handler, const std::string &socketPath) {
+  // a client that disconnects mid-response must not kill the server; the
+  // failed write ends that stream instead
+  std::signal(SIGPIPE, SIG_IGN);
+
+  if (socketPath.empty()) {
+    serveStream(handler, STDIN_FILENO, STDOUT_FILENO);
+    return 0;
+  }
+
+  sockaddr_un addr;
+  std::memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (socketPath.size() >= sizeof(addr.sun_path)) {
+    std::cerr << "Socket path is too long: " << socketPath << std::endl;
+    return 1;
+  }
+  std::strncpy(addr.sun_path, socketPath.c_str(), sizeof(addr.sun_path) - 1);
+
+  int serverFd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (serverFd < 0) {
+    std::cerr << "socket: " << std::strerror(errno) << std::endl;
+    return 1;
+  }
+
+  unlink(socketPath.c_str());
+  if (bind(serverFd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0 ||
+      listen(serverFd, 1) < 0) {
+    std::cerr << "Failed to listen on " << socketPath << ": "
+              << std::strerror(errno) << std::endl;
+    close(serverFd);
+    return 1;
+  }
+
+  bool running = true;
+  while (running) {
+    int clientFd = accept(serverFd, nullptr, nullptr);
+    if (clientFd < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      std::cerr << "accept: " << std::strerror(errno) << std::endl;
+      break;
+    }
+    running = serveStream(handler, clientFd, clientFd);
+    close(clientFd);
+  }
+
+  close(serverFd);
+  unlink(socketPath.c_str());
+  return 0;
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+/**
+ * Handles one request. args is the argv of a regular invocation, minus the
+ * program name, e.g. ["readTags", "output.json", volumeID, "0", ...].
+ * The returned json is sent back as the response.
+ */
+using RequestHandler =
+    std::function<nlohmann::json(const std::vector<std::string> &args)>;
+
+/**
+ * Serves requests until the peer closes the stream or sends ["quit"].
+ *
+ * Every message in either direction is a 4-byte little-endian length
+ * followed by that many bytes of JSON. Requests are JSON arrays of strings;
+ * responses are whatever the handler returns. A request longer than 64 MB
+ * closes the stream.
+ *
+ * With an empty socketPath, requests are read from stdin and responses
+ * written to stdout. Otherwise a Unix domain socket is created at
+ * socketPath and connections are served one at a time.
+ *
+ * Returns a process exit code.
+ */
+int serve(const RequestHandler &handler, const std::string &socketPath);
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/**
+ * Returns the byte to code point table of a single-byte iconv charset
+ * (ISO-8859-1 through -9, TIS-620), or nullptr for any other charset.
+ * Entries cover bytes 0x80-0xFF; lower bytes are ASCII.
+ */
+const uint16_t *singleByteCharsetTable(const char *iconvCharset);
+
+/**
+ * Transcodes str to UTF-8 with a table from singleByteCharsetTable. Returns
+ * false if str has a byte the charset does not define.
+ */
+bool transcodeSingleByte(const uint16_t *table, const char *str, size_t len,
+                         std::string &out);
@@ -0,0 +1,77 @@
+#include "sliceCache.hpp"
+
+namespace {
+
+// Rough heap cost of an entry
+size_t entryBytes(const CachedSlice &slice) {
+  size_t bytes = sizeof(CachedSlice) + slice.pixelBytes;
+  for (const auto &[tag, value] : slice.tags) {
+    // strings plus hash node
+    bytes += tag.size() + value.size() + 64;
+  }
+  return bytes;
+}
+
+} // namespace
+
+void SliceCache::setBudget(size_t budgetBytes) {
+  m_budget = budgetBytes;
+  this->evictOver(m_budget, nullptr);
+}
+
+CachedSlice &SliceCache::get(const std::string &volumeID, size_t slice) {
+  const std::string k = key(volumeID, slice);
+  auto found = m_index.find(k);
+  if (found != m_index.end()) {
+    m_lru.splice(m_lru.begin(), m_lru, found->second);
+    return found->second->data;
+  }
+
+  m_lru.push_front(Node{volumeID, slice, CachedSlice(), 0});
+  m_index.emplace(k, m_lru.begin());
+  return m_lru.front().data;
+}
+
+const CachedSlice *SliceCache::peek(const std::string &volumeID,
+                                    size_t slice) const {
+  auto found = m_index.find(key(volumeID, slice));
+  return found != m_index.end() ? &found->second->data : nullptr;
+}
+
+void SliceCache::update(const std::string &volumeID, size_t slice) {
+  auto found = m_index.find(key(volumeID, slice));
+  if (found == m_index.end()) {
+    return;
+  }
+  Node &node = *found->second;
+  m_bytes -= node.bytes;
+  node.bytes = entryBytes(node.data);
+  m_bytes += node.bytes;
+  this->evictOver(m_budget, &node);
+}
+
+void SliceCache::erase(const std::string &volumeID) {
+  for (auto it = m_lru.begin(); it != m_lru.end();) {
+    if (it->volumeID == volumeID) {
+      m_bytes -= it->bytes;
+      m_index.erase(key(it->volumeID, it->slice));
+      it = m_lru.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+void SliceCache::evictOver(size_t budget, const Node *keep) {
+  auto it = m_lru.end();
+  while (m_bytes > budget && it != m_lru.begin()) {
+    --it;
+    if (&*it == keep) {
+      continue;
+    }
+    m_bytes -= it->bytes;
+    m_index.erase(key(it->volumeID, it->slice));
+    it = m_lru.erase(it);
+    m_stats.evictions++;
+  }
+}
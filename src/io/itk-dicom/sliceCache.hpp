@@ -0,0 +1,92 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <string>
+#include <unordered_map>
+
+#include "itkCommonEnums.h"
+#include "itkImageBase.h"
+
+#include "tagReader.hpp"
+
+/**
+ * What has been read from one slice file so far.
+ */
+struct CachedSlice {
+  // tag values read so far; tags missing from the file are cached as ""
+  TagValueMap tags;
+  // the decoded, rescaled slice as an itk::Image<T, 3>, or null
+  itk::ImageBase<3>::Pointer image;
+  // the T of image
+  itk::IOComponentEnum componentType =
+      itk::IOComponentEnum::UNKNOWNCOMPONENTTYPE;
+  // the component type GDCM decodes the file to, once a header read found it
+  itk::IOComponentEnum fileComponentType =
+      itk::IOComponentEnum::UNKNOWNCOMPONENTTYPE;
+  size_t pixelBytes = 0;
+};
+
+struct SliceCacheStats {
+  uint64_t tagHits = 0;
+  uint64_t tagMisses = 0;
+  uint64_t pixelHits = 0;
+  uint64_t pixelMisses = 0;
+  uint64_t evictions = 0;
+};
+
+/**
+ * Parsed headers and decoded pixels of slices, keyed by (volumeID, slice
+ * index), evicted least recently used first once they exceed a byte budget.
+ *
+ * Entries are filled in place: get() an entry, add tags or an image, then
+ * update() it so its size is counted. update() never evicts the entry it is
+ * called for, so a reference from get() stays valid until the next get() or
+ * update() of another slice.
+ */
+class SliceCache {
+public:
+  explicit SliceCache(size_t budgetBytes) : m_budget(budgetBytes) {}
+
+  // Evicts down to the new budget right away.
+  void setBudget(size_t budgetBytes);
+  size_t budget() const { return m_budget; }
+
+  // Returns the entry, creating an empty one, and marks it most recently
+  // used.
+  CachedSlice &get(const std::string &volumeID, size_t slice);
+  // Returns the entry if there is one, without marking it used.
+  const CachedSlice *peek(const std::string &volumeID, size_t slice) const;
+  // Re-counts the entry's size, then evicts other entries while over
+  // budget.
+  void update(const std::string &volumeID, size_t slice);
+  // Drops all entries of a volume, e.g. when its slice list changes.
+  void erase(const std::string &volumeID);
+
+  size_t bytes() const { return m_bytes; }
+  size_t size() const { return m_lru.size(); }
+  SliceCacheStats &stats() { return m_stats; }
+  const SliceCacheStats &stats() const { return m_stats; }
+
+private:
+  struct Node {
+    std::string volumeID;
+    size_t slice;
+    CachedSlice data;
+    size_t bytes = 0;
+  };
+  using NodeList = std::list<Node>;
+
+  static std::string key(const std::string &volumeID, size_t slice) {
+    return volumeID + '|' + std::to_string(slice);
+  }
+  void evictOver(size_t budget, const Node *keep);
+
+  // most recently used first
+  NodeList m_lru;
+  std::unordered_map<std::string, NodeList::iterator> m_index;
+  size_t m_budget;
+  size_t m_bytes = 0;
+  SliceCacheStats m_stats;
+};
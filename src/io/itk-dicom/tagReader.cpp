@@ -0,0 +1,43 @@
+#include <fstream>
+
+#include "gdcmReader.h"
+#include "gdcmStringFilter.h"
+
+#include "tagReader.hpp"
+#include "trace.hpp"
+
+TagReader::TagReader(const std::vector<std::string> &tags) {
+  for (const auto &name : tags) {
+    gdcm::Tag tag;
+    if (tag.ReadFromPipeSeparatedString(name.c_str())) {
+      m_tags.emplace_back(name, tag);
+      m_tagSet.insert(tag);
+    } else {
+      // never matches; read() reports it as empty
+      m_tags.emplace_back(name, gdcm::Tag(0xffff, 0xffff));
+    }
+  }
+}
+
+bool TagReader::read(const std::string &filename, TagValueMap &values) const {
+  TraceScope trace("readTagsFromFile");
+
+  std::ifstream stream(filename, std::ios::binary);
+  gdcm::Reader reader;
+  reader.SetStream(stream);
+  const bool read = reader.ReadSelectedTags(m_tagSet);
+  traceFileRead(stream);
+  if (!read) {
+    return false;
+  }
+
+  const gdcm::File &file = reader.GetFile();
+  const gdcm::DataSet &ds = file.GetDataSet();
+  gdcm::StringFilter sf;
+  sf.SetFile(file);
+
+  for (const auto &[name, tag] : m_tags) {
+    values[name] = ds.FindDataElement(tag) ? sf.ToString(tag) : "";
+  }
+  return true;
+}
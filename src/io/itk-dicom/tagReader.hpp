@@ -0,0 +1,37 @@
+#pragma once
+
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "gdcmTag.h"
+
+// tag ("gggg|eeee") -> value
+using TagValueMap = std::unordered_map<std::string, std::string>;
+
+/**
+ * Reads a fixed set of tags from DICOM files.
+ *
+ * This works directly on gdcm::Reader with a tag filter, so parsing stops
+ * after the largest requested tag and only the requested elements are
+ * decoded. Nothing of the pixel data or the rest of the header is touched.
+ * Values are formatted the same way as GDCMImageIO's metadata dictionary.
+ */
+class TagReader {
+public:
+  // Tags are in "gggg|eeee" form. Malformed tags are ignored and read back
+  // as empty values.
+  explicit TagReader(const std::vector<std::string> &tags);
+
+  /**
+   * Fills values with every requested tag, using an empty string for tags
+   * missing from the file. Returns false if the file is unreadable.
+   */
+  bool read(const std::string &filename, TagValueMap &values) const;
+
+private:
+  std::set<gdcm::Tag> m_tagSet;
+  std::vector<std::pair<std::string, gdcm::Tag>> m_tags;
+};
@@ -0,0 +1,163 @@
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "../binaryResult.hpp"
+#include "../rawVolume.hpp"
+
+// dicom_format_test [--write] FIXTURE_DIR
+//
+// Writes a sample binary result and raw volume, checks their header fields
+// at the offsets documented in binaryResult.hpp and rawVolume.hpp, and
+// compares them byte for byte with the golden files in FIXTURE_DIR. The JS
+// readers are tested against the same golden files, so a change on either
+// side shows up as a failure. --write regenerates the golden files instead.
+
+namespace {
+
+int failures = 0;
+
+void check(bool ok, const std::string &what) {
+  if (!ok) {
+    std::cerr << "FAIL: " << what << std::endl;
+    failures++;
+  }
+}
+
+std::vector<char> readFile(const std::string &filename) {
+  std::ifstream file(filename, std::ios::binary);
+  return std::vector<char>((std::istreambuf_iterator<char>(file)),
+                           std::istreambuf_iterator<char>());
+}
+
+template <typename T> T get(const std::vector<char> &bytes, size_t offset) {
+  T value{};
+  if (offset + sizeof(T) <= bytes.size()) {
+    std::memcpy(&value, bytes.data() + offset, sizeof(T));
+  }
+  return value;
+}
+
+bool hasMagic(const std::vector<char> &bytes, const char *magic) {
+  return bytes.size() >= 4 && std::memcmp(bytes.data(), magic, 4) == 0;
+}
+
+// Checks the written file against its golden copy, or replaces the golden
+// copy with it.
+void compareGolden(const std::string &written, const std::string &golden,
+                   bool update) {
+  const std::vector<char> bytes = readFile(written);
+  if (update) {
+    std::ofstream out(golden, std::ios::binary);
+    out.write(bytes.data(), bytes.size());
+    check(bool(out), "cannot write " + golden);
+    return;
+  }
+  check(bytes == readFile(golden), written + " differs from " + golden);
+}
+
+void testBinaryResult(const std::string &fixtureDir, bool update) {
+  BinaryResult result;
+  result.addStrings("volumeIDs", {"a", "", "J\xc3\xa9r\xc3\xb4me"});
+  result.addArray<float>("positions", {1.5f, -2.0f, 3.25f});
+  result.addArray<int32_t>("ids", {7, -1});
+  result.write("binaryResult.bin");
+
+  const std::vector<char> bytes = readFile("binaryResult.bin");
+  check(hasMagic(bytes, "PVMB"), "binary result magic");
+  check(get<uint32_t>(bytes, 4) == 1, "binary result version");
+  check(get<uint32_t>(bytes, 8) == 3, "binary result column count");
+
+  // names follow the 3 directory entries; volumeIDs is first
+  const size_t entry = 16;
+  check(get<uint32_t>(bytes, entry) == 16 + 3 * 32, "first name offset");
+  check(get<uint32_t>(bytes, entry + 4) == 9, "first name length");
+  check(get<uint32_t>(bytes, entry + 8) == BinaryResult::String,
+        "first column type");
+  check(get<uint32_t>(bytes, entry + 12) == 3, "first column count");
+  // 4 offsets and 1 + 0 + 8 bytes of UTF-8
+  check(get<uint64_t>(bytes, entry + 24) == 4 * 4 + 9, "first data length");
+
+  for (size_t i = 0; i < 3; i++) {
+    const uint64_t dataOffset = get<uint64_t>(bytes, 16 + 32 * i + 16);
+    check(dataOffset % 8 == 0, "column data is 8-byte aligned");
+  }
+  const uint64_t positions = get<uint64_t>(bytes, 16 + 32 + 16);
+  check(get<float>(bytes, positions + 4) == -2.0f, "float column value");
+  const uint64_t ids = get<uint64_t>(bytes, 16 + 64 + 16);
+  check(get<int32_t>(bytes, ids + 4) == -1, "int32 column value");
+  check(bytes.size() == ids + 8, "file ends after the last column");
+
+  compareGolden("binaryResult.bin", fixtureDir + "/binaryResult.bin", update);
+}
+
+void testRawVolume(const std::string &fixtureDir, bool update) {
+  RawVolumeInfo info;
+  info.componentType = itk::IOComponentEnum::SHORT;
+  const uint64_t size[3] = {3, 2, 1};
+  const double spacing[3] = {0.5, 0.5, 2};
+  const double origin[3] = {10, -20, 30};
+  const double direction[9] = {1, 0, 0, 0, 0, 1, 0, -1, 0};
+  std::copy_n(size, 3, info.size);
+  std::copy_n(spacing, 3, info.spacing);
+  std::copy_n(origin, 3, info.origin);
+  std::copy_n(direction, 9, info.direction);
+
+  const int16_t pixels[6] = {-1000, 0, 1, 2, 3, 3000};
+  {
+    RawVolumeFile file("rawVolume.bin", info);
+    check(file.pixelsLength() == sizeof(pixels), "raw volume pixels length");
+    std::memcpy(file.pixels(), pixels, sizeof(pixels));
+    file.close();
+  }
+
+  const std::vector<char> bytes = readFile("rawVolume.bin");
+  check(hasMagic(bytes, "PVMV"), "raw volume magic");
+  check(get<uint32_t>(bytes, 4) == 1, "raw volume version");
+  check(get<uint32_t>(bytes, 8) == RawVolumeFile::Int16, "raw pixel type");
+  check(get<uint32_t>(bytes, 12) == 2, "raw pixel bytes");
+  for (unsigned i = 0; i < 3; i++) {
+    check(get<uint64_t>(bytes, 16 + 8 * i) == size[i], "raw size");
+    check(get<double>(bytes, 40 + 8 * i) == spacing[i], "raw spacing");
+    check(get<double>(bytes, 64 + 8 * i) == origin[i], "raw origin");
+  }
+  for (unsigned i = 0; i < 9; i++) {
+    check(get<double>(bytes, 88 + 8 * i) == direction[i], "raw direction");
+  }
+  check(bytes.size() == 256 + sizeof(pixels), "raw volume length");
+  check(get<int16_t>(bytes, 256 + 2 * 5) == 3000, "raw pixel value");
+
+  compareGolden("rawVolume.bin", fixtureDir + "/rawVolume.bin", update);
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  bool update = false;
+  std::string fixtureDir;
+  for (int i = 1; i < argc; i++) {
+    std::string arg(argv[i]);
+    if (arg == "--write") {
+      update = true;
+    } else {
+      fixtureDir = arg;
+    }
+  }
+  if (fixtureDir.empty()) {
+    std::cerr << "Usage: " << argv[0] << " [--write] FIXTURE_DIR" << std::endl;
+    return 1;
+  }
+
+  testBinaryResult(fixtureDir, update);
+  testRawVolume(fixtureDir, update);
+
+  if (failures) {
+    std::cerr << failures << " check(s) failed" << std::endl;
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,103 @@
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../headerIndex.hpp"
+
+// dicom_header_index_test
+//
+// Splits synthetic axial stacks with SeparateOnGeometry and checks which
+// parts come out: even stacks stay whole, while missing slices, odd gaps
+// and spacing changes split them into evenly spaced parts.
+
+namespace {
+
+int failures = 0;
+
+void check(bool ok, const std::string &what) {
+  if (!ok) {
+    std::cerr << "FAIL: " << what << std::endl;
+    failures++;
+  }
+}
+
+// An axial stack with slices at the given z positions.
+HeaderList makeStack(const std::vector<double> &positions) {
+  HeaderList headers;
+  for (size_t i = 0; i < positions.size(); i++) {
+    SliceHeader header;
+    header.filename = "slice" + std::to_string(i) + ".dcm";
+    header.orientation = {1, 0, 0, 0, 1, 0};
+    header.position = {0, 0, positions[i]};
+    header.hasPosition = true;
+    header.instanceNumber = static_cast<int>(i) + 1;
+    header.hasInstanceNumber = true;
+    headers.push_back(header);
+  }
+  return headers;
+}
+
+std::vector<double> evenPositions(size_t count, double spacing) {
+  std::vector<double> positions;
+  for (size_t i = 0; i < count; i++) {
+    positions.push_back(i * spacing);
+  }
+  return positions;
+}
+
+// Checks that the stack splits into parts of the given sizes, named
+// vol.S1, vol.S2, ..., or vol if there is one.
+void checkParts(const std::vector<double> &positions,
+                const std::vector<size_t> &sizes, const std::string &what) {
+  const HeaderMapType parts =
+      SeparateOnGeometry({{"vol", makeStack(positions)}});
+  check(parts.size() == sizes.size(), what + ": number of parts");
+  for (size_t i = 0; i < sizes.size(); i++) {
+    const std::string id =
+        sizes.size() > 1 ? "vol.S" + std::to_string(i + 1) : "vol";
+    auto found = parts.find(id);
+    check(found != parts.end() && found->second.size() == sizes[i],
+          what + ": size of " + id);
+  }
+}
+
+void testEvenStack() {
+  checkParts(evenPositions(10, 1.0), {10}, "even stack");
+
+  // DS values rounded to 0.01 mm
+  std::vector<double> rounded = evenPositions(200, 0.625);
+  for (auto &z : rounded) {
+    z = std::round(z * 100) / 100;
+  }
+  checkParts(rounded, {200}, "rounded positions");
+}
+
+void testMissingSlice() {
+  std::vector<double> positions = evenPositions(10, 1.0);
+  positions.erase(positions.begin() + 5);
+  checkParts(positions, {5, 4}, "missing slice");
+}
+
+void testOddLastGap() {
+  checkParts({0, 1, 2, 3, 4.5}, {4, 1}, "odd last gap");
+}
+
+void testSpacingChange() {
+  checkParts({0, 1, 2, 3, 5, 7, 9}, {4, 3}, "spacing change");
+}
+
+} // namespace
+
+int main() {
+  testEvenStack();
+  testMissingSlice();
+  testOddLastGap();
+  testSpacingChange();
+
+  if (failures) {
+    std::cerr << failures << " check(s) failed" << std::endl;
+    return 1;
+  }
+  return 0;
+}
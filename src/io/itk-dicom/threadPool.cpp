@@ -0,0 +1,162 @@
+#include <algorithm>
+
+#include "threadPool.hpp"
+
+ThreadPool::ThreadPool(unsigned numThreads)
+    : m_size(std::max(1u, DICOM_HAS_THREADS ? numThreads : 1u)) {
+  for (unsigned i = 0; i < m_size; i++) {
+    m_queues.emplace_back(new Queue);
+  }
+#if DICOM_HAS_THREADS
+  // queue 0 belongs to the calling thread
+  for (unsigned i = 1; i < m_size; i++) {
+    m_workers.emplace_back([this, i] { this->workerLoop(i); });
+  }
+#endif
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(m_wakeMutex);
+    m_stop = true;
+  }
+  m_wake.notify_all();
+  for (auto &worker : m_workers) {
+    worker.join();
+  }
+}
+
+void ThreadPool::push(size_t queueIndex, Task task) {
+  Queue &queue = *m_queues[queueIndex];
+  std::lock_guard<std::mutex> lock(queue.mutex);
+  queue.tasks.push_back(std::move(task));
+}
+
+bool ThreadPool::popOrSteal(size_t queueIndex, Task &task) {
+  {
+    Queue &own = *m_queues[queueIndex];
+    std::lock_guard<std::mutex> lock(own.mutex);
+    if (!own.tasks.empty()) {
+      task = std::move(own.tasks.back());
+      own.tasks.pop_back();
+      --m_pending;
+      return true;
+    }
+  }
+
+  for (size_t offset = 1; offset < m_queues.size(); offset++) {
+    Queue &victim = *m_queues[(queueIndex + offset) % m_queues.size()];
+    std::lock_guard<std::mutex> lock(victim.mutex);
+    if (!victim.tasks.empty()) {
+      task = std::move(victim.tasks.front());
+      victim.tasks.pop_front();
+      --m_pending;
+      return true;
+    }
+  }
+  return false;
+}
+
+void ThreadPool::workerLoop(size_t queueIndex) {
+  while (true) {
+    Task task;
+    if (this->popOrSteal(queueIndex, task)) {
+      task();
+      continue;
+    }
+
+    std::unique_lock<std::mutex> lock(m_wakeMutex);
+    m_wake.wait(lock, [this] { return m_stop || m_pending > 0; });
+    if (m_stop) {
+      return;
+    }
+    // There are queued tasks somewhere. If another worker claims them
+    // first, we come back around and wait.
+  }
+}
+
+void ThreadPool::parallelFor(size_t count,
+                             const std::function<void(size_t)> &fn,
+                             size_t grain) {
+  if (count == 0) {
+    return;
+  }
+  grain = std::max<size_t>(1, grain);
+
+  if (m_size == 1 || count <= grain) {
+    for (size_t i = 0; i < count; i++) {
+      fn(i);
+    }
+    return;
+  }
+
+  size_t numChunks = (count + grain - 1) / grain;
+  size_t remaining = numChunks;
+  std::mutex errorMutex;
+  std::exception_ptr error;
+  std::mutex doneMutex;
+  std::condition_variable done;
+
+  // count the chunks as queued before any of them can be claimed
+  m_pending += numChunks;
+
+  // spread the chunks out round-robin so every worker starts with work
+  for (size_t chunk = 0; chunk < numChunks; chunk++) {
+    size_t begin = chunk * grain;
+    size_t end = std::min(count, begin + grain);
+    this->push(chunk % m_queues.size(), [&, begin, end] {
+      try {
+        for (size_t i = begin; i < end; i++) {
+          fn(i);
+        }
+      } catch (...) {
+        std::lock_guard<std::mutex> lock(errorMutex);
+        if (!error) {
+          error = std::current_exception();
+        }
+      }
+      // decrement under the lock, otherwise the caller could return and
+      // destroy doneMutex before we get to notify
+      std::lock_guard<std::mutex> lock(doneMutex);
+      if (--remaining == 0) {
+        done.notify_all();
+      }
+    });
+  }
+
+  {
+    // pairs with the predicate check in workerLoop so no wakeup is lost
+    std::lock_guard<std::mutex> lock(m_wakeMutex);
+  }
+  m_wake.notify_all();
+
+  // the calling thread works off queue 0 until nothing is left to steal
+  Task task;
+  while (this->popOrSteal(0, task)) {
+    task();
+  }
+
+  std::unique_lock<std::mutex> lock(doneMutex);
+  done.wait(lock, [&] { return remaining == 0; });
+
+  if (error) {
+    std::rethrow_exception(error);
+  }
+}
+
+ThreadPool &sharedThreadPool(unsigned numThreads) {
+  static std::unique_ptr<ThreadPool> pool;
+  unsigned size = DICOM_HAS_THREADS ? std::max(1u, numThreads) : 1u;
+  if (!pool || pool->size() != size) {
+    pool.reset(new ThreadPool(numThreads));
+  }
+  return *pool;
+}
+
+unsigned defaultThreadCount() {
+#if DICOM_HAS_THREADS
+  return std::max(1u, std::thread::hardware_concurrency());
+#else
+  return 1;
+#endif
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Threads are available in native builds, and in web builds only when
+// emscripten is building with pthreads.
+#if !defined(WEB_BUILD) || defined(__EMSCRIPTEN_PTHREADS__)
+#define DICOM_HAS_THREADS 1
+#else
+#define DICOM_HAS_THREADS 0
+#endif
+
+/**
+ * A small work-stealing thread pool.
+ *
+ * Each worker owns a deque of tasks. Workers pop from the back of their own
+ * deque and steal from the front of the others when they run dry, so uneven
+ * per-task cost (e.g. files on a slow mount) balances out across workers.
+ */
+class ThreadPool {
+public:
+  using Task = std::function<void()>;
+
+  // numThreads includes the calling thread, which also runs tasks during
+  // parallelFor. A pool of size 0 or 1 runs everything inline.
+  explicit ThreadPool(unsigned numThreads);
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  unsigned size() const { return m_size; }
+
+  /**
+   * Runs fn(i) for every i in [0, count) and blocks until all are done.
+   * Indices are handed out in chunks of `grain`. The first exception thrown
+   * by fn is rethrown here after the remaining tasks have finished.
+   */
+  void parallelFor(size_t count, const std::function<void(size_t)> &fn,
+                   size_t grain = 1);
+
+private:
+  struct Queue {
+    std::mutex mutex;
+    std::deque<Task> tasks;
+  };
+
+  void push(size_t queueIndex, Task task);
+  bool popOrSteal(size_t queueIndex, Task &task);
+  void workerLoop(size_t queueIndex);
+
+  unsigned m_size;
+  // one queue per worker, plus one for the calling thread
+  std::vector<std::unique_ptr<Queue>> m_queues;
+  std::vector<std::thread> m_workers;
+
+  std::mutex m_wakeMutex;
+  std::condition_variable m_wake;
+  std::atomic<size_t> m_pending{0};
+  bool m_stop = false;
+};
+
+/**
+ * Returns a process-wide pool with the given number of threads. The pool is
+ * recreated if the requested size changes.
+ */
+ThreadPool &sharedThreadPool(unsigned numThreads);
+
+/**
+ * Default thread count: all hardware threads when threading is available,
+ * otherwise 1.
+ */
+unsigned defaultThreadCount();
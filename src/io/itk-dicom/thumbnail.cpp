@@ -0,0 +1,147 @@
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+#include "thumbnail.hpp"
+
+namespace {
+
+// Parses the first value of a (possibly multi-valued) DS string.
+bool parseFirstDS(const std::string &value, double &number) {
+  try {
+    number = std::stod(value.substr(0, value.find('\\')));
+  } catch (const std::exception &) {
+    return false;
+  }
+  return true;
+}
+
+/**
+ * Averages factor x factor blocks of a grayscale slice into `out`. Edge
+ * blocks average over the pixels they have.
+ *
+ * Block rows are first summed into a full-width row of floats. That loop is
+ * contiguous and branch-free, so the compiler vectorizes it (SSE/NEON, or
+ * wasm simd128 when enabled); the horizontal reduction is then only done
+ * once per block row.
+ */
+template <typename T>
+void boxFilter(const T *pixels, unsigned width, unsigned height,
+               unsigned factor, unsigned outWidth, unsigned outHeight,
+               std::vector<float> &out) {
+  std::vector<float> colSum(width);
+  out.assign(size_t(outWidth) * outHeight, 0.f);
+
+  for (unsigned oy = 0; oy < outHeight; oy++) {
+    const unsigned y0 = oy * factor;
+    const unsigned y1 = std::min(height, y0 + factor);
+
+    std::fill(colSum.begin(), colSum.end(), 0.f);
+    for (unsigned y = y0; y < y1; y++) {
+      const T *row = pixels + size_t(y) * width;
+      for (unsigned x = 0; x < width; x++) {
+        colSum[x] += static_cast<float>(row[x]);
+      }
+    }
+
+    float *outRow = out.data() + size_t(oy) * outWidth;
+    for (unsigned ox = 0; ox < outWidth; ox++) {
+      const unsigned x0 = ox * factor;
+      const unsigned x1 = std::min(width, x0 + factor);
+      float sum = 0.f;
+      for (unsigned x = x0; x < x1; x++) {
+        sum += colSum[x];
+      }
+      outRow[ox] = sum / float((y1 - y0) * (x1 - x0));
+    }
+  }
+}
+
+} // namespace
+
+ThumbnailWindow makeThumbnailWindow(const std::string &center,
+                                    const std::string &width,
+                                    const std::string &photometric) {
+  ThumbnailWindow window;
+  window.hasWindow = parseFirstDS(center, window.center) &&
+                     parseFirstDS(width, window.width) && window.width >= 1.0;
+  window.invert = photometric.find("MONOCHROME1") != std::string::npos;
+  return window;
+}
+
+template <typename T>
+Thumbnail makeThumbnail(const T *pixels, unsigned width, unsigned height,
+                        unsigned size, const ThumbnailWindow &window) {
+  if (width == 0 || height == 0) {
+    throw std::runtime_error("Cannot make a thumbnail of an empty slice");
+  }
+
+  Thumbnail thumb;
+  size = std::max(1u, std::min(size, 0xffffu));
+  thumb.factor = std::max(1u, (std::max(width, height) + size - 1) / size);
+  thumb.width = (width + thumb.factor - 1) / thumb.factor;
+  thumb.height = (height + thumb.factor - 1) / thumb.factor;
+
+  std::vector<float> values;
+  boxFilter(pixels, width, height, thumb.factor, thumb.width, thumb.height,
+            values);
+
+  // VOI LUT from the file (PS3.3 C.11.2.1.2), else the value range
+  double lower, upper;
+  if (window.hasWindow) {
+    lower = window.center - 0.5 - (window.width - 1) / 2;
+    upper = window.center - 0.5 + (window.width - 1) / 2;
+  } else {
+    const auto range = std::minmax_element(values.begin(), values.end());
+    lower = *range.first;
+    upper = *range.second;
+  }
+
+  const float scale = upper > lower ? float(255.0 / (upper - lower)) : 0.f;
+  const float offset = float(lower);
+
+  thumb.pixels.resize(values.size());
+  for (size_t i = 0; i < values.size(); i++) {
+    float v = std::min(255.f, std::max(0.f, (values[i] - offset) * scale));
+    if (window.invert) {
+      v = 255.f - v;
+    }
+    thumb.pixels[i] = static_cast<uint8_t>(v + 0.5f);
+  }
+
+  return thumb;
+}
+
+#define INSTANTIATE_MAKE_THUMBNAIL(T)                                          \
+  template Thumbnail makeThumbnail<T>(const T *, unsigned, unsigned, unsigned, \
+                                      const ThumbnailWindow &);
+INSTANTIATE_MAKE_THUMBNAIL(unsigned char)
+INSTANTIATE_MAKE_THUMBNAIL(signed char)
+INSTANTIATE_MAKE_THUMBNAIL(unsigned short)
+INSTANTIATE_MAKE_THUMBNAIL(short)
+INSTANTIATE_MAKE_THUMBNAIL(unsigned int)
+INSTANTIATE_MAKE_THUMBNAIL(int)
+INSTANTIATE_MAKE_THUMBNAIL(float)
+INSTANTIATE_MAKE_THUMBNAIL(double)
+#undef INSTANTIATE_MAKE_THUMBNAIL
+
+const Thumbnail *ThumbnailCache::find(const std::string &volumeID,
+                                      unsigned long slice,
+                                      unsigned size) const {
+  auto volume = m_volumes.find(volumeID);
+  if (volume == m_volumes.end()) {
+    return nullptr;
+  }
+  auto found = volume->second.find(key(slice, size));
+  return found == volume->second.end() ? nullptr : &found->second;
+}
+
+const Thumbnail &ThumbnailCache::insert(const std::string &volumeID,
+                                        unsigned long slice, unsigned size,
+                                        Thumbnail thumbnail) {
+  return m_volumes[volumeID][key(slice, size)] = std::move(thumbnail);
+}
+
+void ThumbnailCache::erase(const std::string &volumeID) {
+  m_volumes.erase(volumeID);
+}
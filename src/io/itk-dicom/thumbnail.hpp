@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * An 8-bit grayscale preview of one DICOM slice.
+ */
+struct Thumbnail {
+  unsigned width = 0;
+  unsigned height = 0;
+  // source pixels per thumbnail pixel along each axis
+  unsigned factor = 1;
+  std::vector<uint8_t> pixels;
+};
+
+/**
+ * How a slice is mapped to 8 bits: the first VOI window of the file (PS3.3
+ * C.11.2.1.2), if it has one, and whether it is MONOCHROME1.
+ */
+struct ThumbnailWindow {
+  bool hasWindow = false;
+  double center = 0;
+  double width = 0;
+  bool invert = false;
+};
+
+/**
+ * Makes a window from WindowCenter (0028|1050), WindowWidth (0028|1051) and
+ * PhotometricInterpretation (0028|0004) values. Only the first of several
+ * windows is used.
+ */
+ThumbnailWindow makeThumbnailWindow(const std::string &center,
+                                    const std::string &width,
+                                    const std::string &photometric);
+
+/**
+ * Box-filters a decoded, rescaled grayscale slice of width x height pixels
+ * so neither side exceeds `size`. Values are windowed with the given window,
+ * or with the min/max of the downsampled pixels if it has none.
+ *
+ * Instantiated for the pixel types of dispatchComponentType.
+ */
+template <typename T>
+Thumbnail makeThumbnail(const T *pixels, unsigned width, unsigned height,
+                        unsigned size, const ThumbnailWindow &window);
+
+/**
+ * Thumbnails keyed by (volumeID, slice, size).
+ */
+class ThumbnailCache {
+public:
+  const Thumbnail *find(const std::string &volumeID, unsigned long slice,
+                        unsigned size) const;
+  const Thumbnail &insert(const std::string &volumeID, unsigned long slice,
+                          unsigned size, Thumbnail thumbnail);
+  // Drops all thumbnails of a volume, e.g. when its slice list changes.
+  void erase(const std::string &volumeID);
+
+private:
+  static uint64_t key(unsigned long slice, unsigned size) {
+    return (static_cast<uint64_t>(slice) << 16) | (size & 0xffff);
+  }
+
+  std::unordered_map<std::string, std::unordered_map<uint64_t, Thumbnail>>
+      m_volumes;
+};
@@ -0,0 +1,230 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <sys/stat.h>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#ifndef WEB_BUILD
+#include <sys/resource.h>
+#endif
+
+#include <nlohmann/json.hpp>
+
+#include "trace.hpp"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Span {
+  const char *name;
+  int64_t start;
+  int64_t end;
+  unsigned thread;
+};
+
+std::atomic<bool> Enabled{false};
+TraceMode Mode = TraceMode::Off;
+std::string Action;
+std::string ChromeFile;
+Clock::time_point Start;
+
+std::atomic<uint64_t> FilesOpened{0};
+std::atomic<uint64_t> BytesRead{0};
+// process peak memory when the action began
+uint64_t PeakAtStart = 0;
+
+std::mutex SpansMutex;
+std::vector<Span> Spans;
+// small track numbers for the trace viewer, in order of first use
+std::unordered_map<std::thread::id, unsigned> ThreadIDs;
+
+// Peak memory of the process so far in KB: max RSS natively. Wasm memory
+// only grows, so its current size is the peak. In serve mode this includes
+// earlier actions, so summaries also report how much the action raised it.
+uint64_t processPeakMemoryKB() {
+#ifdef WEB_BUILD
+  return uint64_t(__builtin_wasm_memory_size(0)) * 64;
+#else
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  // KB on Linux
+  return usage.ru_maxrss;
+#endif
+}
+
+const char *processPeakName() {
+#ifdef WEB_BUILD
+  return "wasmHeapKB";
+#else
+  return "processPeakRSSKB";
+#endif
+}
+
+const char *peakGrowthName() {
+#ifdef WEB_BUILD
+  return "wasmHeapGrowthKB";
+#else
+  return "peakRSSGrowthKB";
+#endif
+}
+
+// How far the action raised the process peak; 0 if it stayed below an
+// earlier action's peak.
+uint64_t peakGrowthKB(uint64_t peak) {
+  return peak > PeakAtStart ? peak - PeakAtStart : 0;
+}
+
+void writeSummary(int64_t total) {
+  // spans are recorded when they end; list stages by when they first start
+  std::stable_sort(
+      Spans.begin(), Spans.end(),
+      [](const Span &a, const Span &b) { return a.start < b.start; });
+
+  // stage -> total time and run count
+  std::vector<std::pair<const char *, std::pair<int64_t, size_t>>> stages;
+  std::map<std::string, size_t> stageIndex;
+  for (const auto &span : Spans) {
+    auto found = stageIndex.try_emplace(span.name, stages.size());
+    if (found.second) {
+      stages.push_back({span.name, {0, 0}});
+    }
+    auto &stage = stages[found.first->second].second;
+    stage.first += span.end - span.start;
+    stage.second++;
+  }
+
+  char buffer[64];
+  std::cerr << "trace: " << Action;
+  std::snprintf(buffer, sizeof(buffer), " total=%.1fms", total / 1000.0);
+  std::cerr << buffer;
+  for (const auto &[name, stage] : stages) {
+    std::snprintf(buffer, sizeof(buffer), "=%.1fms", stage.first / 1000.0);
+    std::cerr << ' ' << name << buffer;
+    if (stage.second > 1) {
+      std::cerr << "(x" << stage.second << ')';
+    }
+  }
+  const uint64_t peak = processPeakMemoryKB();
+  std::cerr << " files=" << FilesOpened << " bytes=" << BytesRead << ' '
+            << processPeakName() << '=' << peak << ' ' << peakGrowthName()
+            << '=' << peakGrowthKB(peak) << std::endl;
+}
+
+void writeChromeTrace(int64_t total) {
+  using json = nlohmann::json;
+  const uint64_t peak = processPeakMemoryKB();
+  json events = json::array();
+  events.push_back({{"name", Action},
+                    {"ph", "X"},
+                    {"ts", 0},
+                    {"dur", total},
+                    {"pid", 1},
+                    {"tid", 0}});
+  for (const auto &span : Spans) {
+    events.push_back({{"name", span.name},
+                      {"ph", "X"},
+                      {"ts", span.start},
+                      {"dur", span.end - span.start},
+                      {"pid", 1},
+                      {"tid", span.thread}});
+  }
+  events.push_back({{"name", "counters"},
+                    {"ph", "C"},
+                    {"ts", total},
+                    {"pid", 1},
+                    {"args",
+                     {{"filesOpened", FilesOpened.load()},
+                      {"bytesRead", BytesRead.load()},
+                      {processPeakName(), peak},
+                      {peakGrowthName(), peakGrowthKB(peak)}}}});
+
+  std::ofstream out(ChromeFile);
+  out << json{{"traceEvents", events}, {"displayTimeUnit", "ms"}}.dump();
+  if (!out) {
+    std::cerr << "trace: cannot write " << ChromeFile << std::endl;
+  }
+}
+
+} // namespace
+
+void beginTrace(TraceMode mode, const std::string &action,
+                const std::string &chromeFile) {
+  Mode = mode;
+  Action = action;
+  ChromeFile = chromeFile;
+  FilesOpened = 0;
+  BytesRead = 0;
+  PeakAtStart = mode != TraceMode::Off ? processPeakMemoryKB() : 0;
+  Spans.clear();
+  ThreadIDs.clear();
+  // the action itself is track 0
+  ThreadIDs[std::this_thread::get_id()] = 0;
+  Start = Clock::now();
+  Enabled.store(mode != TraceMode::Off, std::memory_order_relaxed);
+}
+
+void endTrace() {
+  if (!traceEnabled()) {
+    return;
+  }
+  Enabled.store(false, std::memory_order_relaxed);
+
+  const int64_t total = traceNow();
+  if (Mode == TraceMode::Chrome) {
+    writeChromeTrace(total);
+  } else {
+    writeSummary(total);
+  }
+  Spans.clear();
+  Mode = TraceMode::Off;
+}
+
+bool traceEnabled() { return Enabled.load(std::memory_order_relaxed); }
+
+int64_t traceNow() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() -
+                                                               Start)
+      .count();
+}
+
+void traceSpan(const char *name, int64_t start, int64_t end) {
+  if (!traceEnabled()) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(SpansMutex);
+  auto thread = ThreadIDs.try_emplace(std::this_thread::get_id(),
+                                      ThreadIDs.size());
+  Spans.push_back({name, start, end, thread.first->second});
+}
+
+void traceFileRead(uint64_t bytes) {
+  if (traceEnabled()) {
+    FilesOpened.fetch_add(1, std::memory_order_relaxed);
+    BytesRead.fetch_add(bytes, std::memory_order_relaxed);
+  }
+}
+
+void traceFileRead(const std::string &filename) {
+  if (traceEnabled()) {
+    struct stat st;
+    traceFileRead(stat(filename.c_str(), &st) == 0 ? uint64_t(st.st_size)
+                                                    : 0);
+  }
+}
+
+void traceFileRead(std::istream &stream) {
+  if (traceEnabled()) {
+    // the stream may be at EOF; tellg needs the flags cleared
+    stream.clear();
+    const auto pos = stream.tellg();
+    traceFileRead(pos > 0 ? uint64_t(pos) : 0);
+  }
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+
+/**
+ * Optional per-action tracing: wall time of named stages, file and byte
+ * counters, and memory. Memory is the process peak (max RSS natively, the
+ * Wasm heap in web builds), which spans earlier actions in serve mode, plus
+ * how much this action raised it.
+ *
+ * Summary prints one line to stderr when the action ends. Chrome writes
+ * trace-event JSON (chrome://tracing, Perfetto) to a file, one span per
+ * stage run. When tracing is off, scopes and counters cost one relaxed
+ * atomic load.
+ */
+enum class TraceMode { Off, Summary, Chrome };
+
+// Starts collecting for one action. chromeFile is only used in Chrome mode.
+void beginTrace(TraceMode mode, const std::string &action,
+                const std::string &chromeFile = "");
+// Reports what was collected since beginTrace and turns tracing off.
+void endTrace();
+
+bool traceEnabled();
+
+// Microseconds since beginTrace
+int64_t traceNow();
+
+// Records a stage span. name must outlive the trace, e.g. a literal.
+void traceSpan(const char *name, int64_t start, int64_t end);
+
+/**
+ * Times the enclosing block as a stage. Safe to use from worker threads;
+ * spans on different threads show up on separate tracks.
+ */
+class TraceScope {
+public:
+  explicit TraceScope(const char *name)
+      : m_name(traceEnabled() ? name : nullptr),
+        m_start(m_name ? traceNow() : 0) {}
+  ~TraceScope() {
+    if (m_name) {
+      traceSpan(m_name, m_start, traceNow());
+    }
+  }
+
+  TraceScope(const TraceScope &) = delete;
+  TraceScope &operator=(const TraceScope &) = delete;
+
+private:
+  const char *m_name;
+  int64_t m_start;
+};
+
+// Counts one opened file and the bytes read from it.
+void traceFileRead(uint64_t bytes);
+// Counts one opened file that is read whole, using its size on disk.
+void traceFileRead(const std::string &filename);
+// Counts one opened file and how far into it the stream got, e.g. after a
+// header read that stops before the pixel data.
+void traceFileRead(std::istream &stream);
@@ -0,0 +1,633 @@
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <stdexcept>
+#include <string_view>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+
+#include "treParser.hpp"
+
+namespace {
+
+/**
+ * Read-only view of a whole file. Uses mmap, or reads the file into memory
+ * where mmap is not available.
+ */
+class MappedFile {
+public:
+  explicit MappedFile(const std::string &filename) {
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+      throw std::runtime_error("Cannot open " + filename);
+    }
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+      m_size = st.st_size;
+      void *addr = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (addr != MAP_FAILED) {
+        m_mapped = static_cast<const char *>(addr);
+      }
+    }
+    close(fd);
+
+    if (!m_mapped && m_size > 0) {
+      std::ifstream file(filename, std::ios::binary);
+      m_buffer.resize(m_size);
+      file.read(m_buffer.data(), m_size);
+    }
+  }
+
+  ~MappedFile() {
+    if (m_mapped) {
+      munmap(const_cast<char *>(m_mapped), m_size);
+    }
+  }
+
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  const char *data() const { return m_mapped ? m_mapped : m_buffer.data(); }
+  size_t size() const { return m_size; }
+
+private:
+  const char *m_mapped = nullptr;
+  size_t m_size = 0;
+  std::vector<char> m_buffer;
+};
+
+bool isSpace(char c) {
+  return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+std::string_view trim(std::string_view str) {
+  while (!str.empty() && isSpace(str.front())) {
+    str.remove_prefix(1);
+  }
+  while (!str.empty() && isSpace(str.back())) {
+    str.remove_suffix(1);
+  }
+  return str;
+}
+
+// Parses one decimal number at p, skipping leading whitespace. The buffer is
+// not NUL-terminated, so strtod cannot be used.
+bool parseNumber(const char *&p, const char *end, double &value) {
+  while (p < end && isSpace(*p)) {
+    ++p;
+  }
+  const char *start = p;
+
+  bool negative = false;
+  if (p < end && (*p == '-' || *p == '+')) {
+    negative = *p == '-';
+    ++p;
+  }
+
+  double mantissa = 0;
+  int exponent = 0;
+  bool digits = false;
+  for (; p < end && *p >= '0' && *p <= '9'; ++p) {
+    mantissa = mantissa * 10 + (*p - '0');
+    digits = true;
+  }
+  if (p < end && *p == '.') {
+    for (++p; p < end && *p >= '0' && *p <= '9'; ++p) {
+      mantissa = mantissa * 10 + (*p - '0');
+      --exponent;
+      digits = true;
+    }
+  }
+  if (!digits) {
+    p = start;
+    return false;
+  }
+  if (p < end && (*p == 'e' || *p == 'E')) {
+    const char *expStart = p;
+    ++p;
+    bool expNegative = false;
+    if (p < end && (*p == '-' || *p == '+')) {
+      expNegative = *p == '-';
+      ++p;
+    }
+    int exp = 0;
+    bool expDigits = false;
+    for (; p < end && *p >= '0' && *p <= '9'; ++p) {
+      exp = std::min(exp * 10 + (*p - '0'), 10000);
+      expDigits = true;
+    }
+    if (expDigits) {
+      exponent += expNegative ? -exp : exp;
+    } else {
+      p = expStart;
+    }
+  }
+
+  value = exponent == 0 ? mantissa : mantissa * std::pow(10.0, exponent);
+  if (negative) {
+    value = -value;
+  }
+  return true;
+}
+
+std::vector<double> parseNumbers(std::string_view str) {
+  std::vector<double> values;
+  const char *p = str.data();
+  const char *end = p + str.size();
+  double value;
+  while (parseNumber(p, end, value)) {
+    values.push_back(value);
+  }
+  return values;
+}
+
+// Parses a header value that must be one integer in [minValue, maxValue],
+// e.g. ID or NPoints. Throws std::runtime_error otherwise, so a malformed
+// file falls back to the ITK reader.
+long long parseInteger(std::string_view key, std::string_view str,
+                       long long minValue, long long maxValue) {
+  const char *p = str.data();
+  const char *end = p + str.size();
+  double value;
+  if (!parseNumber(p, end, value) || value != std::floor(value) ||
+      value < double(minValue) || value > double(maxValue)) {
+    throw std::runtime_error("Bad TRE " + std::string(key) + ": " +
+                             std::string(str));
+  }
+  return static_cast<long long>(value);
+}
+
+bool parseBool(std::string_view str) {
+  return str == "True" || str == "true" || str == "1";
+}
+
+// y = matrix * x + offset
+struct Affine {
+  std::array<double, 9> matrix{1, 0, 0, 0, 1, 0, 0, 0, 1};
+  std::array<double, 3> offset{0, 0, 0};
+
+  bool isIdentity() const {
+    return matrix == Affine().matrix && offset == Affine().offset;
+  }
+
+  Affine then(const Affine &outer) const {
+    Affine result;
+    for (int i = 0; i < 3; i++) {
+      for (int j = 0; j < 3; j++) {
+        double sum = 0;
+        for (int k = 0; k < 3; k++) {
+          sum += outer.matrix[i * 3 + k] * matrix[k * 3 + j];
+        }
+        result.matrix[i * 3 + j] = sum;
+      }
+      double sum = outer.offset[i];
+      for (int k = 0; k < 3; k++) {
+        sum += outer.matrix[i * 3 + k] * offset[k];
+      }
+      result.offset[i] = sum;
+    }
+    return result;
+  }
+
+  // Mean of (r, r, r) transformed as a covariant vector (by the inverse
+  // transpose), like TubeSpatialObjectPoint::GetRadiusInWorldSpace.
+  double radiusScale() const {
+    const auto &m = matrix;
+    const double det = m[0] * (m[4] * m[8] - m[5] * m[7]) -
+                       m[1] * (m[3] * m[8] - m[5] * m[6]) +
+                       m[2] * (m[3] * m[7] - m[4] * m[6]);
+    if (det == 0) {
+      return 1;
+    }
+    // row sums of the inverse transpose = column sums of the inverse
+    const std::array<double, 9> inv{
+        (m[4] * m[8] - m[5] * m[7]) / det, (m[2] * m[7] - m[1] * m[8]) / det,
+        (m[1] * m[5] - m[2] * m[4]) / det, (m[5] * m[6] - m[3] * m[8]) / det,
+        (m[0] * m[8] - m[2] * m[6]) / det, (m[2] * m[3] - m[0] * m[5]) / det,
+        (m[3] * m[7] - m[4] * m[6]) / det, (m[1] * m[6] - m[0] * m[7]) / det,
+        (m[0] * m[4] - m[1] * m[3]) / det};
+    double sum = 0;
+    for (double value : inv) {
+      sum += value;
+    }
+    return sum / 3;
+  }
+};
+
+// Header fields of one object, as far as tubes need them.
+struct ObjectHeader {
+  std::string type;
+  int ndims = 3;
+  int32_t id = -1;
+  int32_t parentID = -1;
+  Affine transform;
+  std::array<double, 3> spacing{1, 1, 1};
+  std::vector<std::string> pointDim;
+  size_t numPoints = 0;
+  bool binary = false;
+  bool binaryMSB = false;
+  std::string elementType = "MET_FLOAT";
+};
+
+// Column of each tube point field in a PointDim row, or -1.
+struct PointColumns {
+  int x = -1, y = -1, z = -1, r = -1;
+  int red = -1, green = -1, blue = -1, alpha = -1, id = -1;
+
+  explicit PointColumns(const std::vector<std::string> &names) {
+    for (int i = 0; i < int(names.size()); i++) {
+      const std::string &name = names[i];
+      if (name == "x") {
+        x = i;
+      } else if (name == "y") {
+        y = i;
+      } else if (name == "z") {
+        z = i;
+      } else if (name == "r" || name == "R" || name == "radius" ||
+                 name == "Radius" || name == "rad" || name == "Rad" ||
+                 name == "s" || name == "S") {
+        r = i;
+      } else if (name == "red") {
+        red = i;
+      } else if (name == "green") {
+        green = i;
+      } else if (name == "blue") {
+        blue = i;
+      } else if (name == "alpha") {
+        alpha = i;
+      } else if (name == "id" || name == "ID") {
+        id = i;
+      }
+    }
+  }
+};
+
+class TREParser {
+public:
+  TREParser(const char *data, size_t size) : m_p(data), m_end(data + size) {}
+
+  TubeTree parse() {
+    // object 0 is the root group that SpatialObjectReader returns
+    m_tree.pointOffsets.push_back(0);
+    this->addObject(-1, -1);
+    m_tree.pointOffsets.push_back(0);
+    m_transforms.emplace_back();
+
+    ObjectHeader header;
+    bool inObject = false;
+    std::string_view key, value;
+    while (this->nextField(key, value)) {
+      if (key == "ObjectType") {
+        if (inObject) {
+          this->finishObject(header, false);
+        }
+        header = ObjectHeader();
+        header.type = value;
+        // the scene is the root group itself
+        inObject = value != "Scene";
+      } else if (!inObject) {
+        continue;
+      } else if (key == "NDims") {
+        header.ndims = parseInteger(key, value, 1, 16);
+      } else if (key == "ID") {
+        header.id = parseInteger(key, value, INT32_MIN, INT32_MAX);
+      } else if (key == "ParentID") {
+        header.parentID = parseInteger(key, value, INT32_MIN, INT32_MAX);
+      } else if (key == "TransformMatrix" || key == "Rotation" ||
+                 key == "Orientation") {
+        auto values = parseNumbers(value);
+        if (values.size() == 9) {
+          std::copy(values.begin(), values.end(),
+                    header.transform.matrix.begin());
+        }
+      } else if (key == "Offset" || key == "Position" || key == "Origin") {
+        auto values = parseNumbers(value);
+        for (size_t i = 0; i < 3 && i < values.size(); i++) {
+          header.transform.offset[i] = values[i];
+        }
+      } else if (key == "ElementSpacing") {
+        auto values = parseNumbers(value);
+        for (size_t i = 0; i < 3 && i < values.size(); i++) {
+          header.spacing[i] = values[i];
+        }
+      } else if (key == "PointDim") {
+        header.pointDim.clear();
+        size_t pos = 0;
+        std::string names(value);
+        while (pos < names.size()) {
+          size_t next = names.find_first_of(" \t", pos);
+          if (next == std::string::npos) {
+            next = names.size();
+          }
+          if (next > pos) {
+            header.pointDim.push_back(names.substr(pos, next - pos));
+          }
+          pos = next + 1;
+        }
+      } else if (key == "NPoints") {
+        header.numPoints = parseInteger(key, value, 0, UINT32_MAX);
+      } else if (key == "BinaryData") {
+        header.binary = parseBool(value);
+      } else if (key == "BinaryDataByteOrderMSB" ||
+                 key == "ElementByteOrderMSB") {
+        header.binaryMSB = parseBool(value);
+      } else if (key == "ElementType") {
+        header.elementType = value;
+      } else if (key == "Points") {
+        this->finishObject(header, true);
+        inObject = false;
+      }
+    }
+    if (inObject) {
+      this->finishObject(header, false);
+    }
+
+    this->resolveHierarchy();
+    return std::move(m_tree);
+  }
+
+private:
+  // Reads the next "Key = Value" line. Returns false at end of file.
+  bool nextField(std::string_view &key, std::string_view &value) {
+    while (m_p < m_end) {
+      const char *lineEnd =
+          static_cast<const char *>(memchr(m_p, '\n', m_end - m_p));
+      if (!lineEnd) {
+        lineEnd = m_end;
+      }
+      std::string_view line(m_p, lineEnd - m_p);
+      m_p = lineEnd < m_end ? lineEnd + 1 : m_end;
+
+      size_t eq = line.find('=');
+      if (eq == std::string_view::npos) {
+        if (!trim(line).empty()) {
+          throw std::runtime_error("Unexpected TRE line: " +
+                                   std::string(trim(line)));
+        }
+        continue;
+      }
+      key = trim(line.substr(0, eq));
+      value = trim(line.substr(eq + 1));
+      return true;
+    }
+    return false;
+  }
+
+  void addObject(int32_t id, int32_t parentID) {
+    m_tree.ids.push_back(id);
+    m_tree.parents.push_back(parentID);
+  }
+
+  // Adds the object and reads its points, if the header ended in Points.
+  void finishObject(const ObjectHeader &header, bool hasPoints) {
+    const bool isTube = header.type == "Tube";
+    if (hasPoints && header.numPoints > 0 && !isTube) {
+      throw std::runtime_error("Cannot stream points of " + header.type +
+                               " objects");
+    }
+    if (isTube && header.ndims != 3) {
+      throw std::runtime_error("Only 3D tubes can be streamed");
+    }
+
+    this->addObject(header.id, header.parentID);
+    m_transforms.push_back(header.transform);
+    if (isTube && hasPoints) {
+      this->readPoints(header);
+    }
+    m_tree.pointOffsets.push_back(m_tree.pointIds.size());
+  }
+
+  void readPoints(const ObjectHeader &header) {
+    const size_t dim = header.pointDim.size();
+    PointColumns columns(header.pointDim);
+    if (dim == 0 || columns.x < 0 || columns.y < 0 || columns.z < 0) {
+      throw std::runtime_error("Tube PointDim has no x y z");
+    }
+
+    // NPoints is not trusted for sizing until the data could hold that many
+    // points; in text every value takes at least a digit and a separator.
+    const size_t remaining = m_end - m_p;
+    const size_t maxPoints =
+        header.binary ? remaining / (binaryElementSize(header) * dim)
+                      : (remaining + 1) / (2 * dim);
+    if (header.numPoints > maxPoints) {
+      throw std::runtime_error("Truncated TRE point data");
+    }
+
+    const size_t first = m_tree.pointIds.size();
+    const size_t count = first + header.numPoints;
+    m_tree.pointIds.resize(count);
+    m_tree.positions.resize(count * 3);
+    m_tree.radii.resize(count);
+    m_tree.colors.resize(count * 4);
+
+    std::vector<double> row(dim);
+    auto get = [&](int column, double fallback) {
+      return column >= 0 ? row[column] : fallback;
+    };
+
+    for (size_t i = first; i < count; i++) {
+      if (header.binary) {
+        this->readBinaryRow(header, row);
+      } else {
+        for (size_t d = 0; d < dim; d++) {
+          if (!parseNumber(m_p, m_end, row[d])) {
+            throw std::runtime_error("Truncated TRE point data");
+          }
+        }
+      }
+
+      // point values are in index space, scaled by the element spacing
+      m_tree.positions[3 * i + 0] = row[columns.x] * header.spacing[0];
+      m_tree.positions[3 * i + 1] = row[columns.y] * header.spacing[1];
+      m_tree.positions[3 * i + 2] = row[columns.z] * header.spacing[2];
+      m_tree.radii[i] = get(columns.r, 0) * header.spacing[0];
+      // TubeSpatialObjectPoint defaults
+      m_tree.colors[4 * i + 0] = get(columns.red, 1);
+      m_tree.colors[4 * i + 1] = get(columns.green, 0);
+      m_tree.colors[4 * i + 2] = get(columns.blue, 0);
+      m_tree.colors[4 * i + 3] = get(columns.alpha, 1);
+      m_tree.pointIds[i] = get(columns.id, -1);
+    }
+
+    if (header.binary) {
+      return;
+    }
+    // the rest of the last point line
+    while (m_p < m_end && *m_p != '\n') {
+      ++m_p;
+    }
+  }
+
+  // Bytes per binary value. Throws for element types other than float and
+  // double.
+  static size_t binaryElementSize(const ObjectHeader &header) {
+    if (header.elementType == "MET_DOUBLE") {
+      return 8;
+    }
+    if (header.elementType != "MET_FLOAT") {
+      throw std::runtime_error("Cannot stream TRE element type " +
+                               header.elementType);
+    }
+    return 4;
+  }
+
+  void readBinaryRow(const ObjectHeader &header, std::vector<double> &row) {
+    const size_t elementSize = binaryElementSize(header);
+    const bool isDouble = elementSize == 8;
+    if (size_t(m_end - m_p) < elementSize * row.size()) {
+      throw std::runtime_error("Truncated TRE point data");
+    }
+
+    for (auto &value : row) {
+      char bytes[8];
+      std::memcpy(bytes, m_p, elementSize);
+      if (header.binaryMSB) {
+        std::reverse(bytes, bytes + elementSize);
+      }
+      if (isDouble) {
+        double v;
+        std::memcpy(&v, bytes, 8);
+        value = v;
+      } else {
+        float v;
+        std::memcpy(&v, bytes, 4);
+        value = v;
+      }
+      m_p += elementSize;
+    }
+  }
+
+  // Orders objects depth-first under their parents and moves points to world
+  // space. Files written by ITK are already depth-first, so usually nothing
+  // moves.
+  void resolveHierarchy() {
+    const size_t numObjects = m_tree.ids.size();
+
+    // parent IDs to parent indices; unknown parents hang off the root
+    std::unordered_map<int32_t, int32_t> indexOfID;
+    for (size_t i = numObjects; i-- > 1;) {
+      indexOfID[m_tree.ids[i]] = i;
+    }
+    std::vector<std::vector<int32_t>> children(numObjects);
+    std::vector<int32_t> parentIndex(numObjects, -1);
+    for (size_t i = 1; i < numObjects; i++) {
+      auto found = indexOfID.find(m_tree.parents[i]);
+      int32_t parent = found != indexOfID.end() && size_t(found->second) != i
+                           ? found->second
+                           : 0;
+      parentIndex[i] = parent;
+      children[parent].push_back(i);
+    }
+
+    // depth-first order, and world transforms along the way
+    std::vector<int32_t> order;
+    std::vector<Affine> world(numObjects);
+    std::vector<bool> visited(numObjects, false);
+    std::vector<int32_t> stack{0};
+    while (!stack.empty()) {
+      int32_t index = stack.back();
+      stack.pop_back();
+      if (visited[index]) {
+        continue; // parent cycle
+      }
+      visited[index] = true;
+      order.push_back(index);
+      world[index] =
+          index == 0
+              ? m_transforms[0]
+              : m_transforms[index].then(world[parentIndex[index]]);
+      for (auto it = children[index].rbegin(); it != children[index].rend();
+           ++it) {
+        stack.push_back(*it);
+      }
+    }
+    // objects stuck in a parent cycle go under the root
+    for (size_t i = 1; i < numObjects; i++) {
+      if (!visited[i]) {
+        parentIndex[i] = 0;
+        world[i] = m_transforms[i];
+        order.push_back(i);
+      }
+    }
+
+    for (size_t i = 0; i < numObjects; i++) {
+      const Affine &transform = world[i];
+      if (transform.isIdentity()) {
+        continue;
+      }
+      const double radiusScale = transform.radiusScale();
+      for (uint32_t p = m_tree.pointOffsets[i]; p < m_tree.pointOffsets[i + 1];
+           p++) {
+        float *pos = &m_tree.positions[3 * p];
+        const double x = pos[0], y = pos[1], z = pos[2];
+        for (int d = 0; d < 3; d++) {
+          pos[d] = transform.matrix[d * 3 + 0] * x +
+                   transform.matrix[d * 3 + 1] * y +
+                   transform.matrix[d * 3 + 2] * z + transform.offset[d];
+        }
+        m_tree.radii[p] *= radiusScale;
+      }
+    }
+
+    bool inOrder = true;
+    for (size_t i = 0; i < order.size(); i++) {
+      inOrder = inOrder && order[i] == int32_t(i);
+    }
+    if (inOrder) {
+      for (size_t i = 0; i < numObjects; i++) {
+        m_tree.parents[i] = parentIndex[i];
+      }
+      return;
+    }
+    this->reorder(order, parentIndex);
+  }
+
+  void reorder(const std::vector<int32_t> &order,
+               const std::vector<int32_t> &parentIndex) {
+    std::vector<int32_t> newIndex(order.size());
+    for (size_t i = 0; i < order.size(); i++) {
+      newIndex[order[i]] = i;
+    }
+
+    TubeTree sorted;
+    sorted.pointOffsets.push_back(0);
+    for (int32_t old : order) {
+      sorted.ids.push_back(m_tree.ids[old]);
+      sorted.parents.push_back(old == 0 ? -1 : newIndex[parentIndex[old]]);
+
+      const uint32_t begin = m_tree.pointOffsets[old];
+      const uint32_t end = m_tree.pointOffsets[old + 1];
+      auto append = [&](auto &to, const auto &from, size_t stride) {
+        to.insert(to.end(), from.begin() + begin * stride,
+                  from.begin() + end * stride);
+      };
+      append(sorted.pointIds, m_tree.pointIds, 1);
+      append(sorted.positions, m_tree.positions, 3);
+      append(sorted.radii, m_tree.radii, 1);
+      append(sorted.colors, m_tree.colors, 4);
+      sorted.pointOffsets.push_back(sorted.pointIds.size());
+    }
+    m_tree = std::move(sorted);
+  }
+
+  const char *m_p;
+  const char *m_end;
+  TubeTree m_tree;
+  // object-to-parent transform of each object
+  std::vector<Affine> m_transforms;
+};
+
+} // namespace
+
+TubeTree parseTubeTree(const std::string &filename) {
+  MappedFile file(filename);
+  return TREParser(file.data(), file.size()).parse();
+}
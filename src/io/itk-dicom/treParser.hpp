@@ -0,0 +1,20 @@
+#pragma once
+
+#include <string>
+
+#include "readTRE.hpp"
+
+/**
+ * Parses a MetaIO TRE file straight into a TubeTree, without building the
+ * SpatialObject hierarchy. The file is memory-mapped and point blocks (text
+ * or binary float/double) are tokenized directly into the output arrays, so
+ * peak memory is about the size of the output.
+ *
+ * The result matches readTubeTree: a root group (id -1) followed by the file's
+ * objects in depth-first order, with points in world space.
+ *
+ * Throws std::runtime_error for content it does not handle (non-tube objects
+ * with point data, tubes that are not 3D, unknown element types); callers can
+ * fall back to readTubeTree.
+ */
+TubeTree parseTubeTree(const std::string &filename);
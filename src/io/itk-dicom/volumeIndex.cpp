@@ -0,0 +1,180 @@
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <stdexcept>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+#include "volumeIndex.hpp"
+
+using json = nlohmann::json;
+
+// bump when the layout below changes; older indices are then rebuilt
+static const int IndexVersion = 5;
+static const char *IndexFilename = ".volume-index";
+
+std::string volumeIndexPath(const std::string &volumeID) {
+  return volumeID + "/" + IndexFilename;
+}
+
+VolumeIndex makeVolumeIndex(const HeaderList &sortedHeaders) {
+  VolumeIndex index;
+  index.slices = sortedHeaders;
+  // volume-level tags are kept once, below
+  for (auto &slice : index.slices) {
+    slice.keyTags.clear();
+  }
+
+  if (!sortedHeaders.empty()) {
+    const auto &names = keyTagNames();
+    const auto &values = sortedHeaders.front().keyTags;
+    for (size_t i = 0; i < names.size() && i < values.size(); i++) {
+      index.tags[names[i]] = values[i];
+    }
+  }
+  return index;
+}
+
+// The index is stored as CBOR with the per-slice fields laid out as
+// parallel arrays, which keeps it compact for volumes with thousands of
+// slices.
+static void unpackVolumeIndex(const json &data, VolumeIndex &index) {
+  const auto &files = data.at("files");
+  const auto seriesID = data.at("seriesID").get<std::string>();
+  const auto &orientations = data.at("orientations");
+  const auto &positions = data.at("positions");
+  const auto &hasPositions = data.at("hasPositions");
+  const auto &instanceNumbers = data.at("instanceNumbers");
+  const auto &hasInstanceNumbers = data.at("hasInstanceNumbers");
+  const auto &rescaleIntercepts = data.at("rescaleIntercepts");
+  const auto &rescaleSlopes = data.at("rescaleSlopes");
+  const auto &echoNumbers = data.at("echoNumbers");
+  const auto &temporalPositions = data.at("temporalPositions");
+  const auto &triggerTimes = data.at("triggerTimes");
+  const auto &sopInstanceUIDs = data.at("sopInstanceUIDs");
+  const auto &contentHashes = data.at("contentHashes");
+
+  size_t numSlices = files.size();
+  index.slices.clear();
+  index.slices.resize(numSlices);
+  for (size_t i = 0; i < numSlices; i++) {
+    SliceHeader &slice = index.slices[i];
+    slice.filename = files.at(i).get<std::string>();
+    slice.seriesID = seriesID;
+    slice.orientation.resize(6);
+    for (size_t j = 0; j < 6; j++) {
+      slice.orientation[j] = orientations.at(i * 6 + j).get<double>();
+    }
+    slice.hasPosition = hasPositions.at(i).get<bool>();
+    slice.position.clear();
+    if (slice.hasPosition) {
+      for (size_t j = 0; j < 3; j++) {
+        slice.position.push_back(positions.at(i * 3 + j).get<double>());
+      }
+    }
+    slice.hasInstanceNumber = hasInstanceNumbers.at(i).get<bool>();
+    slice.instanceNumber = instanceNumbers.at(i).get<int>();
+    slice.rescaleIntercept = rescaleIntercepts.at(i).get<double>();
+    slice.rescaleSlope = rescaleSlopes.at(i).get<double>();
+    slice.echoNumber = echoNumbers.at(i).get<std::string>();
+    slice.temporalPosition = temporalPositions.at(i).get<std::string>();
+    slice.triggerTime = triggerTimes.at(i).get<double>();
+    slice.sopInstanceUID = sopInstanceUIDs.at(i).get<std::string>();
+    slice.contentHash = contentHashes.at(i).get<uint64_t>();
+  }
+
+  index.tags =
+      data.at("tags").get<std::unordered_map<std::string, std::string>>();
+}
+
+bool readVolumeIndex(const std::string &volumeID, VolumeIndex &index) {
+  std::ifstream infile(volumeIndexPath(volumeID), std::ios::binary);
+  if (!infile) {
+    return false;
+  }
+  std::vector<uint8_t> bytes((std::istreambuf_iterator<char>(infile)),
+                             std::istreambuf_iterator<char>());
+
+  json data = json::from_cbor(bytes, true, false);
+  // a corrupt index can still decode to a valid non-object value
+  if (data.is_discarded() || !data.is_object()) {
+    return false;
+  }
+
+  try {
+    const auto version = data.find("version");
+    if (version == data.end() || !version->is_number_integer() ||
+        version->get<int>() != IndexVersion) {
+      return false;
+    }
+    unpackVolumeIndex(data, index);
+  } catch (const json::exception &e) {
+    std::cerr << "Ignoring bad index for volume " << volumeID << ": "
+              << e.what() << std::endl;
+    return false;
+  }
+  return true;
+}
+
+void writeVolumeIndex(const std::string &volumeID, const VolumeIndex &index) {
+  json files = json::array();
+  json orientations = json::array();
+  json positions = json::array();
+  json hasPositions = json::array();
+  json instanceNumbers = json::array();
+  json hasInstanceNumbers = json::array();
+  json rescaleIntercepts = json::array();
+  json rescaleSlopes = json::array();
+  json echoNumbers = json::array();
+  json temporalPositions = json::array();
+  json triggerTimes = json::array();
+  json sopInstanceUIDs = json::array();
+  json contentHashes = json::array();
+
+  for (const auto &slice : index.slices) {
+    files.push_back(slice.filename);
+    for (double value : slice.orientation) {
+      orientations.push_back(value);
+    }
+    for (int i = 0; i < 3; i++) {
+      positions.push_back(slice.hasPosition ? slice.position[i] : 0.0);
+    }
+    hasPositions.push_back(slice.hasPosition);
+    instanceNumbers.push_back(slice.instanceNumber);
+    hasInstanceNumbers.push_back(slice.hasInstanceNumber);
+    rescaleIntercepts.push_back(slice.rescaleIntercept);
+    rescaleSlopes.push_back(slice.rescaleSlope);
+    echoNumbers.push_back(slice.echoNumber);
+    temporalPositions.push_back(slice.temporalPosition);
+    triggerTimes.push_back(slice.triggerTime);
+    sopInstanceUIDs.push_back(slice.sopInstanceUID);
+    contentHashes.push_back(slice.contentHash);
+  }
+
+  json data = {
+      {"version", IndexVersion},
+      {"seriesID", index.slices.empty() ? "" : index.slices[0].seriesID},
+      {"files", files},
+      {"orientations", orientations},
+      {"positions", positions},
+      {"hasPositions", hasPositions},
+      {"instanceNumbers", instanceNumbers},
+      {"hasInstanceNumbers", hasInstanceNumbers},
+      {"rescaleIntercepts", rescaleIntercepts},
+      {"rescaleSlopes", rescaleSlopes},
+      {"echoNumbers", echoNumbers},
+      {"temporalPositions", temporalPositions},
+      {"triggerTimes", triggerTimes},
+      {"sopInstanceUIDs", sopInstanceUIDs},
+      {"contentHashes", contentHashes},
+      {"tags", index.tags},
+  };
+
+  std::vector<uint8_t> bytes = json::to_cbor(data);
+  std::ofstream outfile(volumeIndexPath(volumeID), std::ios::binary);
+  if (!outfile) {
+    throw std::runtime_error("Failed to write index for volume " + volumeID);
+  }
+  outfile.write(reinterpret_cast<const char *>(bytes.data()), bytes.size());
+}
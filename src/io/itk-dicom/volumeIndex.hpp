@@ -0,0 +1,38 @@
+#pragma once
+
+#include <string>
+#include <unordered_map>
+
+#include "headerIndex.hpp"
+
+/**
+ * Everything import learned about one volume, persisted next to its files
+ * so later calls (or later processes) do not have to rescan the directory.
+ */
+struct VolumeIndex {
+  // Sorted slices. Filenames are relative to the working dir: files moved
+  // in by import live in the volume dir, files imported in place stay
+  // wherever they were.
+  HeaderList slices;
+  // keyTagNames() -> raw value, taken from the first slice
+  std::unordered_map<std::string, std::string> tags;
+};
+
+/**
+ * Path of the index file for a volume. It lives inside the volume dir so
+ * that deleteVolume() removes it along with the files.
+ */
+std::string volumeIndexPath(const std::string &volumeID);
+
+/**
+ * Builds an index from sorted headers.
+ */
+VolumeIndex makeVolumeIndex(const HeaderList &sortedHeaders);
+
+/**
+ * Returns false if there is no index for the volume, or if it is unreadable
+ * or from an incompatible version.
+ */
+bool readVolumeIndex(const std::string &volumeID, VolumeIndex &index);
+
+void writeVolumeIndex(const std::string &volumeID, const VolumeIndex &index);
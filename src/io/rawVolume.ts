@@ -0,0 +1,166 @@
+/**
+ * Reader for the raw volume files written by the dicom module with `--raw`.
+ * See rawVolume.hpp for the layout.
+ *
+ * The pixels are a typed array view onto the file bytes, so nothing is
+ * copied unless the bytes are misaligned for the pixel type.
+ */
+
+export type RawPixels =
+  | Uint8Array
+  | Int8Array
+  | Uint16Array
+  | Int16Array
+  | Uint32Array
+  | Int32Array
+  | Float32Array
+  | Float64Array;
+
+export interface RawVolume {
+  // itk.js component type name, e.g. int16_t
+  componentType: string;
+  size: [number, number, number];
+  spacing: [number, number, number];
+  origin: [number, number, number];
+  // row-major
+  direction: Float64Array;
+  pixels: RawPixels;
+}
+
+const MAGIC = 'PVMV';
+const VERSION = 1;
+const HEADER_SIZE = 256;
+
+interface PixelArrayConstructor {
+  new (
+    buffer: ArrayBufferLike,
+    byteOffset?: number,
+    length?: number
+  ): RawPixels;
+  BYTES_PER_ELEMENT: number;
+}
+
+// indexed by the pixel type in the header
+const PixelArrays: Array<PixelArrayConstructor | null> = [
+  null,
+  Uint8Array,
+  Int8Array,
+  Uint16Array,
+  Int16Array,
+  Uint32Array,
+  Int32Array,
+  Float32Array,
+  Float64Array,
+];
+
+// itk.js component type names, indexed like PixelArrays
+const ComponentTypes = [
+  '',
+  'uint8_t',
+  'int8_t',
+  'uint16_t',
+  'int16_t',
+  'uint32_t',
+  'int32_t',
+  'float',
+  'double',
+];
+
+// itk.js PixelTypes.Scalar
+const SCALAR_PIXEL = 1;
+
+function getUint64(view: DataView, offset: number) {
+  return (
+    view.getUint32(offset, true) + view.getUint32(offset + 4, true) * 2 ** 32
+  );
+}
+
+function getFloat64s(view: DataView, offset: number, count: number) {
+  const values = new Float64Array(count);
+  for (let i = 0; i < count; i += 1) {
+    values[i] = view.getFloat64(offset + 8 * i, true);
+  }
+  return values;
+}
+
+export function isRawVolume(data: Uint8Array) {
+  return (
+    data.length >= HEADER_SIZE &&
+    String.fromCharCode(data[0], data[1], data[2], data[3]) === MAGIC
+  );
+}
+
+export function parseRawVolume(data: Uint8Array): RawVolume {
+  if (!isRawVolume(data)) {
+    throw new Error('Not a raw volume');
+  }
+
+  const view = new DataView(data.buffer, data.byteOffset, data.byteLength);
+  const version = view.getUint32(4, true);
+  if (version !== VERSION) {
+    throw new Error(`Unsupported raw volume version ${version}`);
+  }
+
+  const pixelType = view.getUint32(8, true);
+  const PixelArray = PixelArrays[pixelType];
+  if (!PixelArray) {
+    throw new Error(`Unknown raw volume pixel type ${pixelType}`);
+  }
+  if (view.getUint32(12, true) !== PixelArray.BYTES_PER_ELEMENT) {
+    throw new Error(`Raw volume pixel size does not match type ${pixelType}`);
+  }
+
+  const size: [number, number, number] = [
+    getUint64(view, 16),
+    getUint64(view, 24),
+    getUint64(view, 32),
+  ];
+  const count = size[0] * size[1] * size[2];
+  const length = count * PixelArray.BYTES_PER_ELEMENT;
+  if (HEADER_SIZE + length > data.byteLength) {
+    throw new Error('Raw volume is truncated');
+  }
+
+  // typed arrays need offsets aligned to their element size
+  const start = data.byteOffset + HEADER_SIZE;
+  const pixels =
+    start % PixelArray.BYTES_PER_ELEMENT === 0
+      ? new PixelArray(data.buffer, start, count)
+      : new PixelArray(data.slice(HEADER_SIZE, HEADER_SIZE + length).buffer);
+
+  const [sx, sy, sz] = getFloat64s(view, 40, 3);
+  const [ox, oy, oz] = getFloat64s(view, 64, 3);
+  return {
+    componentType: ComponentTypes[pixelType],
+    size,
+    spacing: [sx, sy, sz],
+    origin: [ox, oy, oz],
+    direction: getFloat64s(view, 88, 9),
+    pixels,
+  };
+}
+
+/**
+ * Wraps a raw volume as an itk.js image, sharing its pixels. The direction
+ * stays row-major, as itk.js outputs it.
+ */
+export function rawVolumeToItkImage(volume: RawVolume) {
+  return {
+    imageType: {
+      dimension: 3,
+      componentType: volume.componentType,
+      pixelType: SCALAR_PIXEL,
+      components: 1,
+    },
+    name: 'Image',
+    origin: [...volume.origin],
+    spacing: [...volume.spacing],
+    direction: {
+      rows: 3,
+      columns: 3,
+      data: Float64Array.from(volume.direction),
+    },
+    size: [...volume.size],
+    data: volume.pixels,
+  };
+}
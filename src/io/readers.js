@@ -2,7 +2,7 @@ import vtkITKImageReader from '@kitware/vtk.js/IO/Misc/ITKImageReader';
 import extensionToImageIO from 'itk/extensionToImageIO';
 import readImageArrayBuffer from 'itk/readImageArrayBuffer';
 
-import convertJsonToTre from '@/src/vtk/TreJsonConverter';
+import { convertArraysToTre } from '@/src/vtk/TreJsonConverter';
 import { readFileAsArrayBuffer } from './io';
 import { stlReader, vtiReader, vtpReader } from './vtk/async';
 
@@ -29,8 +29,8 @@ export async function itkReader(file) {
 
 export function createTREReader(dicomIO) {
   return async function TREReader(file) {
-    const treData = await dicomIO.readTRE(file);
-    return convertJsonToTre(treData);
+    const treData = await dicomIO.readTREArrays(file);
+    return convertArraysToTre(treData);
   };
 }
 
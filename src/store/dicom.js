@@ -102,10 +102,24 @@ export default (dependencies) => ({
       }
     },
 
+    setNumberOfSlices(state, { volumeKey, numberOfSlices }) {
+      if (volumeKey in state.volumeIndex) {
+        state.volumeIndex = {
+          ...state.volumeIndex,
+          [volumeKey]: {
+            ...state.volumeIndex[volumeKey],
+            NumberOfSlices: numberOfSlices,
+          },
+        };
+        // slice offsets may now refer to other slices
+        Vue.delete(state.imageCache, volumeKey);
+      }
+    },
+
     removeVolume(state, volumeKey) {
       if (volumeKey in state.volumeIndex) {
         const studyKey = state.volumeParent[volumeKey];
-        const idx = state.studyVolume[studyKey].indexOf(volumeKey);
+        const idx = state.studyVolumes[studyKey].indexOf(volumeKey);
         if (idx > -1) {
           state.studyVolumes[studyKey].splice(idx, 1);
           Vue.delete(state.volumeParent, volumeKey);
@@ -145,9 +159,16 @@ export default (dependencies) => ({
         return [];
       }
 
-      const updatedVolumes = await dicomIO.importFiles(files);
+      const { volumeIDs: updatedVolumes, removedVolumeIDs } =
+        await dicomIO.importFiles(files);
       const updatedVolumeKeys = []; // to be returned to caller
 
+      // regrouped into other volumes; their files are already gone
+      removedVolumeIDs.forEach((volumeKey) => {
+        commit('deleteVolume', volumeKey);
+        commit('removeVolume', volumeKey);
+      });
+
       await Promise.all(
         updatedVolumes.map(async (volumeKey) => {
           const numberOfSlices = await dicomIO.buildVolumeList(volumeKey);
@@ -209,6 +230,8 @@ export default (dependencies) => ({
             commit('addPatient', { patientKey, patient });
             commit('addStudy', { studyKey, study, patientKey });
             commit('addVolume', { volumeKey, volumeInfo, studyKey });
+          } else {
+            commit('setNumberOfSlices', { volumeKey, numberOfSlices });
           }
 
           // invalidate existing volume
@@ -123,9 +123,13 @@ export const useDICOMStore = defineStore('dicom', {
         return [];
       }
 
-      const updatedVolumes = await dicomIO.importFiles(files);
+      const { volumeIDs: updatedVolumes, removedVolumeIDs } =
+        await dicomIO.importFiles(files);
       const updatedVolumeKeys: VolumeKeys[] = []; // to be returned to caller
 
+      // regrouped into other volumes; their files are already gone
+      removedVolumeIDs.forEach((volumeKey) => this.deleteVolume(volumeKey));
+
       await Promise.all(
         updatedVolumes.map(async (volumeKey) => {
           const numberOfSlices = await dicomIO.buildVolumeList(volumeKey);
@@ -187,6 +191,13 @@ export const useDICOMStore = defineStore('dicom', {
             });
 
             this._updateDatabase(patient, study, volumeInfo);
+          } else {
+            set(this.volumeInfo, volumeKey, {
+              ...this.volumeInfo[volumeKey],
+              NumberOfSlices: numberOfSlices,
+            });
+            // slice offsets may now refer to other slices
+            set(this.sliceData, volumeKey, {});
           }
 
           // invalidate any existing volume
@@ -326,18 +337,32 @@ export const useDICOMStore = defineStore('dicom', {
         throw new Error(`Cannot find given volume key: ${volumeKey}`);
       }
 
-      const itkImage = await dicomIO.buildVolume(volumeKey);
-      const vtkImage = vtkITKHelper.convertItkToVtkImage(itkImage);
-
-      if (volumeKey in this.volumeToImageID) {
-        const imageID = this.volumeToImageID[volumeKey];
-        imageStore.updateData(imageID, vtkImage);
-      } else {
-        const name = this.volumeInfo[volumeKey].SeriesInstanceUID;
-        const imageID = imageStore.addVTKImageData(name, vtkImage);
-        set(this.volumeToImageID, volumeKey, imageID);
-        set(this.imageIDToVolumeKey, imageID, volumeKey);
-      }
+      const setVolumeImage = (itkImage: any) => {
+        const vtkImage = vtkITKHelper.convertItkToVtkImage(itkImage);
+
+        if (volumeKey in this.volumeToImageID) {
+          const imageID = this.volumeToImageID[volumeKey];
+          imageStore.updateData(imageID, vtkImage);
+        } else {
+          const name = this.volumeInfo[volumeKey].SeriesInstanceUID;
+          const imageID = imageStore.addVTKImageData(name, vtkImage);
+          set(this.volumeToImageID, volumeKey, imageID);
+          set(this.imageIDToVolumeKey, imageID, volumeKey);
+        }
+        return vtkImage;
+      };
+
+      // show a decimated preview while the full volume is built
+      const itkImage = await dicomIO.buildVolumeProgressive(
+        volumeKey,
+        this.volumeInfo[volumeKey].NumberOfSlices,
+        (preview, level) => {
+          if (level > 0) {
+            setVolumeImage(preview);
+          }
+        }
+      );
+      const vtkImage = setVolumeImage(itkImage);
 
       del(this.needsRebuild, volumeKey);
 
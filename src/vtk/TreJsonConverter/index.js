@@ -32,34 +32,29 @@ function concatPointData(pointDataList, arrayName) {
   return da;
 }
 
+// A centerline is { positions, radii, color }, with xyz positions and radii
+// as Float32Arrays and an [r, g, b] color in [0, 1].
 function centerlineToTube(centerline) {
+  const numberOfPoints = centerline.radii.length;
   const pd = vtkPolyData.newInstance();
   const pts = vtkPoints.newInstance({
     dataType: VtkDataTypes.FLOAT,
     numberOfComponents: 3,
   });
-  pts.setNumberOfPoints(centerline.length);
+  pts.setNumberOfPoints(numberOfPoints);
 
-  const pointData = new Float32Array(3 * centerline.length);
-  const lines = new Uint32Array(centerline.length + 1);
-
-  lines[0] = centerline.length;
-  for (let i = 0; i < centerline.length; i += 1) {
-    const [x, y, z] = centerline[i].PositionInWorldSpace;
-    pointData[3 * i + 0] = x;
-    pointData[3 * i + 1] = y;
-    pointData[3 * i + 2] = z;
+  const lines = new Uint32Array(numberOfPoints + 1);
+  lines[0] = numberOfPoints;
+  for (let i = 0; i < numberOfPoints; i += 1) {
     lines[i + 1] = i;
   }
 
-  const radii = centerline.map((pt) => pt.RadiusInWorldSpace);
-  const radiusData = new Float32Array(radii);
   const radius = vtkDataArray.newInstance({
     name: 'Radius',
-    values: radiusData,
+    values: centerline.radii,
   });
 
-  pts.setData(pointData);
+  pts.setData(centerline.positions);
   pd.setPoints(pts);
   pd.getLines().setData(lines);
   pd.getPointData().addArray(radius);
@@ -113,9 +108,9 @@ function convertCenterlinesToTubes(centerlines) {
     const cline = centerlines[i];
     const cellCount = cellCounts[i]; // # of cells for ith tube
     for (let j = 0; j < cellCount; j += 1) {
-      colorData[colorIdx + 0] = cline.Red * 255;
-      colorData[colorIdx + 1] = cline.Green * 255;
-      colorData[colorIdx + 2] = cline.Blue * 255;
+      colorData[colorIdx + 0] = cline.color[0] * 255;
+      colorData[colorIdx + 1] = cline.color[1] * 255;
+      colorData[colorIdx + 2] = cline.color[2] * 255;
       colorData[colorIdx + 3] = 255; // ignore specified alpha for now
     }
   }
@@ -144,7 +139,41 @@ function flattenTreHierarchy(treJson) {
   return list;
 }
 
+function pointListToCenterline(points) {
+  const positions = new Float32Array(3 * points.length);
+  const radii = new Float32Array(points.length);
+  for (let i = 0; i < points.length; i += 1) {
+    positions.set(points[i].PositionInWorldSpace, 3 * i);
+    radii[i] = points[i].RadiusInWorldSpace;
+  }
+  const color = points.length ? points[0].Color : [0, 0, 0];
+  return { positions, radii, color };
+}
+
 export default function convertJsonToTre(treJson) {
-  const centerlines = flattenTreHierarchy(treJson);
+  const centerlines = flattenTreHierarchy(treJson)
+    .filter((points) => points.length)
+    .map(pointListToCenterline);
+  return convertCenterlinesToTubes(centerlines);
+}
+
+/**
+ * Converts the flat arrays from DICOMIO.readTREArrays. Tube points are
+ * already contiguous, so each centerline is a view into the arrays.
+ */
+export function convertArraysToTre(tre) {
+  const { pointOffsets, positions, radii, colors } = tre;
+  const centerlines = [];
+  for (let i = 0; i + 1 < pointOffsets.length; i += 1) {
+    const start = pointOffsets[i];
+    const end = pointOffsets[i + 1];
+    if (end > start) {
+      centerlines.push({
+        positions: positions.subarray(3 * start, 3 * end),
+        radii: radii.subarray(start, end),
+        color: colors.subarray(4 * start, 4 * start + 3),
+      });
+    }
+  }
   return convertCenterlinesToTubes(centerlines);
 }
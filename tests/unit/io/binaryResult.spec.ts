@@ -0,0 +1,32 @@
+/// <reference types="node" />
+import { readFileSync } from 'fs';
+import { expect } from 'chai';
+import { isBinaryResult, parseBinaryResult } from '@src/io/binaryResult';
+
+// Written by binaryResult.cpp; regenerate with
+// `dicom_format_test --write tests/unit/io/fixtures`.
+function readGolden() {
+  return new Uint8Array(
+    readFileSync('tests/unit/io/fixtures/binaryResult.bin')
+  );
+}
+
+describe('Binary results', () => {
+  it('should read string and numeric columns', () => {
+    const bytes = readGolden();
+
+    expect(isBinaryResult(bytes)).to.be.true;
+    const result = parseBinaryResult(bytes);
+    expect(result.volumeIDs).to.deep.equal(['a', '', 'Jérôme']);
+    expect(result.positions).to.be.instanceOf(Float32Array);
+    const positions = Array.from(result.positions as Float32Array);
+    expect(positions).to.deep.equal([1.5, -2, 3.25]);
+    expect(result.ids).to.be.instanceOf(Int32Array);
+    expect(Array.from(result.ids as Int32Array)).to.deep.equal([7, -1]);
+  });
+
+  it('should reject other data', () => {
+    expect(isBinaryResult(new TextEncoder().encode('["a"]'))).to.be.false;
+    expect(() => parseBinaryResult(new Uint8Array(4))).to.throw();
+  });
+});
@@ -0,0 +1,64 @@
+/// <reference types="node" />
+import { readFileSync } from 'fs';
+import { expect } from 'chai';
+import {
+  isRawVolume,
+  parseRawVolume,
+  rawVolumeToItkImage,
+} from '@src/io/rawVolume';
+
+// Written by rawVolume.cpp; regenerate with
+// `dicom_format_test --write tests/unit/io/fixtures`.
+function readGolden() {
+  return new Uint8Array(readFileSync('tests/unit/io/fixtures/rawVolume.bin'));
+}
+
+describe('Raw volumes', () => {
+  it('should view the pixels in place', () => {
+    const bytes = readGolden();
+
+    expect(isRawVolume(bytes)).to.be.true;
+    const volume = parseRawVolume(bytes);
+    expect(volume.componentType).to.equal('int16_t');
+    expect(volume.size).to.deep.equal([3, 2, 1]);
+    expect(volume.spacing).to.deep.equal([0.5, 0.5, 2]);
+    expect(volume.origin).to.deep.equal([10, -20, 30]);
+    expect(Array.from(volume.direction)).to.deep.equal([
+      1, 0, 0, 0, 0, 1, 0, -1, 0,
+    ]);
+    expect(volume.pixels).to.be.instanceOf(Int16Array);
+    expect(volume.pixels.buffer).to.equal(bytes.buffer);
+    expect(Array.from(volume.pixels)).to.deep.equal([-1000, 0, 1, 2, 3, 3000]);
+  });
+
+  it('should wrap as an itk.js image without copying', () => {
+    const volume = parseRawVolume(readGolden());
+    const image = rawVolumeToItkImage(volume);
+
+    expect(image.imageType.componentType).to.equal('int16_t');
+    expect(image.imageType.components).to.equal(1);
+    expect(image.size).to.deep.equal([3, 2, 1]);
+    expect(Array.from(image.direction.data)).to.deep.equal([
+      1, 0, 0, 0, 0, 1, 0, -1, 0,
+    ]);
+    expect(image.data).to.equal(volume.pixels);
+  });
+
+  it('should copy misaligned pixels', () => {
+    const golden = readGolden();
+    const shifted = new Uint8Array(golden.length + 1);
+    shifted.set(golden, 1);
+
+    const volume = parseRawVolume(shifted.subarray(1));
+    expect(volume.pixels).to.be.instanceOf(Int16Array);
+    expect(volume.pixels.buffer).to.not.equal(shifted.buffer);
+    expect(Array.from(volume.pixels)).to.deep.equal([-1000, 0, 1, 2, 3, 3000]);
+  });
+
+  it('should reject other and truncated data', () => {
+    expect(isRawVolume(new Uint8Array(8))).to.be.false;
+    const bytes = readGolden();
+    const truncated = bytes.subarray(0, bytes.length - 1);
+    expect(() => parseRawVolume(truncated)).to.throw();
+  });
+});